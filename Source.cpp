@@ -12,18 +12,47 @@
 #include "camera.h"
 #include "../OpenGLSample/Sphere.h"
 #include "cylinder.h"
+#include "gpu_resources.h"
+#include "indirect_draw.h"
+#include "dynamic_resolution.h"
+#include "tiled_capture.h"
+#include "benchmark.h"
+#include "job_system.h"
+#include "scene_prep.h"
+#include "static_batch.h"
 
 #include <iostream>
+#include <iomanip>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void window_refresh_callback(GLFWwindow* window);
 void processInput(GLFWwindow *window);
-unsigned int loadTexture(const char *path);
+void applyInput(const InputFrame& input);
+CameraState cameraState();
+void runScene(GLFWwindow* window);
+int runPrepBenchmark(size_t objectCount);
+GpuHandle loadTexture(const char *path);
+void setLightingUniforms(Shader& shader, const glm::vec3* pointLightPositions);
+glm::mat4 sceneProjection(float aspect);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const size_t GPU_MEMORY_BUDGET = 0;		// estimated bytes of GPU memory the scene may hold, 0 for no limit
+const float TARGET_FRAME_MS = 16.6f;		// GPU frame time the dynamic resolution controller aims for
+const int CAPTURE_WIDTH = 16384;			// width of F12 captures; the height follows the window's aspect ratio
+const char* const CAPTURE_PATH = "capture.png";
+
+// real framebuffer size, kept up to date by framebuffer_size_callback
+int fbWidth = SCR_WIDTH;
+int fbHeight = SCR_HEIGHT;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -41,15 +70,104 @@ glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 // Perspective
 bool useOrtho = false;
 
-int graterVerts = 0;
-int handleVerts = 0;
-int matVerts = 0;
-int flourVerts = 0;
-int lidVerts = 0;
-int juicerHandleVerts = 0;
-
-int main()
+// GPU resource report (F1)
+bool reportKeyHeld = false;
+
+// job system statistics (F3)
+bool jobStatsRequested = false;
+bool jobStatsKeyHeld = false;
+
+// turn the flour bag (F4), which re-bakes its static batch
+bool turnFlourRequested = false;
+bool turnFlourKeyHeld = false;
+
+// render on demand: the scene is only redrawn when something invalidated it
+bool renderOnDemand = true;
+bool onDemandKeyHeld = false;
+bool sceneInvalidated = true;		// camera, scene or window changed since the last rendered frame
+bool movementKeyHeld = false;		// held keys send no events but move the camera every frame
+const double IDLE_WAIT_TIMEOUT = 0.5;	// seconds to sleep in glfwWaitEventsTimeout while idle
+
+// dynamic resolution (F2 toggles)
+bool useDynamicResolution = true;
+bool dynamicResolutionKeyHeld = false;
+
+// tiled high resolution capture (F12)
+bool captureRequested = false;
+bool captureKeyHeld = false;
+
+// mouse and scroll input gathered by the callbacks, applied once per frame
+float pendingMouseX = 0.0f;
+float pendingMouseY = 0.0f;
+float pendingScroll = 0.0f;
+
+// benchmark: --record writes a camera path, --replay plays one back in place of live input
+enum BenchmarkMode { BENCH_OFF, BENCH_RECORD, BENCH_REPLAY };
+BenchmarkMode benchmarkMode = BENCH_OFF;
+const float BENCH_DELTA_TIME = 1.0f / 60.0f;	// simulated deltaTime while recording or replaying
+std::string benchmarkReportPath = "benchmark.json";
+CameraPathRecorder pathRecorder;
+CameraPathPlayer pathPlayer;
+BenchmarkReport benchmarkReport;
+RenderCounters renderCounters;
+
+int main(int argc, char** argv)
 {
+	// command line: benchmark recording, replay and report comparison
+	// ----------------------------------------------------------------
+	std::string compareBaseline, compareCurrent;
+	double compareThreshold = 5.0;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc)
+		{
+			if (!pathRecorder.open(argv[++i]))
+			{
+				std::cout << "Cannot write camera path " << argv[i] << std::endl;
+				return -1;
+			}
+			benchmarkMode = BENCH_RECORD;
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			if (!pathPlayer.load(argv[++i]))
+			{
+				std::cout << "Cannot read camera path " << argv[i] << std::endl;
+				return -1;
+			}
+			benchmarkMode = BENCH_REPLAY;
+		}
+		else if (arg == "--report" && i + 1 < argc)
+			benchmarkReportPath = argv[++i];
+		else if (arg == "--compare" && i + 2 < argc)
+		{
+			compareBaseline = argv[++i];
+			compareCurrent = argv[++i];
+		}
+		else if (arg == "--threshold" && i + 1 < argc)
+			compareThreshold = atof(argv[++i]);
+		else if (arg == "--prep-bench")
+		{
+			size_t objects = 200000;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				objects = (size_t)atol(argv[++i]);
+			return runPrepBenchmark(objects);
+		}
+		else
+		{
+			std::cout << "usage: " << argv[0] << " [--record path.txt | --replay path.txt [--report out.json|out.csv]]" << std::endl;
+			std::cout << "       " << argv[0] << " --compare baseline.json current.json [--threshold percent]" << std::endl;
+			std::cout << "       " << argv[0] << " --prep-bench [objects]" << std::endl;
+			return -1;
+		}
+	}
+	if (!compareBaseline.empty())
+	{
+		int regressions = BenchmarkReport::compare(compareBaseline, compareCurrent, compareThreshold, std::cout);
+		return regressions == 0 ? 0 : 1;
+	}
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -71,9 +189,11 @@ int main()
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
+	glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
 	// tell GLFW to capture our mouse
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -86,14 +206,46 @@ int main()
 		return -1;
 	}
 
+	gpuResources().setBudget(GPU_MEMORY_BUDGET);
+	runScene(window);
+
+	// every handle is gone once runScene returns, so anything still registered leaked
+	gpuResources().reportLeaks(std::cout);
+
+	// glfw: terminate, clearing all previously allocated GLFW resources.
+	// ------------------------------------------------------------------
+	glfwTerminate();
+	return 0;
+}
+
+// builds the scene and runs the render loop; all GPU resources are owned by locals
+// here so they are released before the context is destroyed
+// --------------------------------------------------------------------------------
+void runScene(GLFWwindow* window)
+{
 	// configure global opengl state
 	// -----------------------------
 	glEnable(GL_DEPTH_TEST);
 
+	// benchmark runs draw every frame; replays also run at full resolution without vsync so runs compare
+	if (benchmarkMode != BENCH_OFF)
+		renderOnDemand = false;
+	if (benchmarkMode == BENCH_REPLAY)
+	{
+		useDynamicResolution = false;
+		glfwSwapInterval(0);
+	}
+
 	// build and compile our shader zprogram
 	// ------------------------------------
 	Shader lightingShader("shaderfiles/6.multiple_lights.vs", "shaderfiles/6.multiple_lights.fs");
 	Shader lightCubeShader("shaderfiles/6.light_cube.vs", "shaderfiles/6.light_cube.fs");
+	Shader indirectShader("shaderfiles/6.multiple_lights_indirect.vs", "shaderfiles/6.multiple_lights_indirect.fs");
+	GpuHandle lightingProgram = gpuResources().adoptProgram(lightingShader.ID, "lightingShader");
+	GpuHandle lightCubeProgram = gpuResources().adoptProgram(lightCubeShader.ID, "lightCubeShader");
+	Shader upscaleShader("shaderfiles/upscale.vs", "shaderfiles/upscale.fs");
+	GpuHandle indirectProgram = gpuResources().adoptProgram(indirectShader.ID, "indirectShader");
+	GpuHandle upscaleProgram = gpuResources().adoptProgram(upscaleShader.ID, "upscaleShader");
 
 	// set up vertex data (and buffer(s)) and configure vertex attributes
 	// ------------------------------------------------------------------
@@ -328,414 +480,330 @@ int main()
 		glm::vec3(-4.0f,  2.0f, -12.0f),
 		glm::vec3(0.0f,  0.0f, -3.0f)
 	};
-	// first, configure the cube's VAO (and VBO)
-	unsigned int graterVBO, graterVAO;
-	glGenVertexArrays(1, &graterVAO);
-	glGenBuffers(1, &graterVBO);
-
-	graterVerts = sizeof(graterVertices);
-	handleVerts = sizeof(handleVertices);
-	matVerts = sizeof(matVertices);
-	flourVerts = sizeof(flourVertices);
-	lidVerts = sizeof(lidVertices);
-	juicerHandleVerts = sizeof(juicerHandleVertices);
-
-	glBindBuffer(GL_ARRAY_BUFFER, graterVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(graterVertices), graterVertices, GL_STATIC_DRAW);
-	
-	glBindVertexArray(graterVAO);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-	// second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
-	unsigned int handleVBO, handleVAO;
-	glGenVertexArrays(1, &handleVAO);
-	glGenBuffers(1, &handleVBO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, handleVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(handleVertices), handleVertices, GL_STATIC_DRAW);
-
-	glBindVertexArray(handleVAO);
-	// note that we update the lamp's position attribute's stride to reflect the updated buffer data
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-
-	unsigned int matVBO, matVAO;
-	glGenVertexArrays(1, &matVAO);
-	glGenBuffers(1, &matVBO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, matVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(matVertices), matVertices, GL_STATIC_DRAW);
-
-	glBindVertexArray(matVAO);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-	unsigned int flourVBO, flourVAO;
-	glGenVertexArrays(1, &flourVAO);
-	glGenBuffers(1, &flourVBO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, flourVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(flourVertices), flourVertices, GL_STATIC_DRAW);
-
-	glBindVertexArray(flourVAO);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-	unsigned int lidVBO, lidVAO;
-	glGenVertexArrays(1, &lidVAO);
-	glGenBuffers(1, &lidVBO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, lidVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(lidVertices), lidVertices, GL_STATIC_DRAW);
-
-	glBindVertexArray(lidVAO);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-	unsigned int juicerVBO, juicerVAO;
-	glGenVertexArrays(1, &juicerVAO);
-	glGenBuffers(1, &juicerVBO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, juicerVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(juicerHandleVertices), juicerHandleVertices, GL_STATIC_DRAW);
-
-	glBindVertexArray(juicerVAO);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
+	// where every object sits; the model matrices are rebuilt from these each frame
+	SceneTransform graterTransform(cubePositions[0], glm::vec3(2.0f, 3.0f, 1.0f));
+	SceneTransform flourTransform(cubePositions[1], glm::vec3(2.5f, 2.5f, 2.5f), 20.0f * 2);
+	SceneTransform lidTransform(cubePositions[2], glm::vec3(2.65f, 0.5f, 2.65f), 20.0f * 2);
+	SceneTransform juicerHandleTransform(cubePositions[4], glm::vec3(4.0f, 0.5f, 0.3f));
+	SceneTransform juicerTransform(cubePositions[3], glm::vec3(1.0f, 1.0f, 1.0f), 20.0f * 0, glm::vec3(1.0f, 0.3f, 0.5f));
+	SceneTransform saltTransform(cubePositions[5], glm::vec3(0.5f, 0.8f, 0.5f), 20.0f * 0, glm::vec3(1.0f, 0.3f, 0.5f));
+	SceneTransform saltTopTransform(cubePositions[5], glm::vec3(0.49f, 1.0f, 0.49f), 20.0f * 0, glm::vec3(1.0f, 0.3f, 0.5f));
+
+	// the set dressing is static: baked into world space, with objects that share a transform
+	// merged into one indirect draw whatever their materials (grater, handle and mat become one
+	// batch); material indices follow the diffuseMaps/specularMaps tables built below
+	IndirectScene staticScene;
+	ScenePrep scenePrep;
+	StaticBatcher staticBatches;
+	staticBatches.add(graterVertices, sizeof(graterVertices), graterTransform, 0);
+	staticBatches.add(handleVertices, sizeof(handleVertices), graterTransform, 1);
+	staticBatches.add(matVertices, sizeof(matVertices), graterTransform, 2);
+	unsigned int flourObject = staticBatches.add(flourVertices, sizeof(flourVertices), flourTransform, 3);
+	staticBatches.add(lidVertices, sizeof(lidVertices), lidTransform, 5);
+	staticBatches.add(juicerHandleVertices, sizeof(juicerHandleVertices), juicerHandleTransform, 4);
+
+	// the sphere and cylinders keep their own buffers; their boxes are conservative
+	// (the cylinder is taken as reaching a full height above and below its centre)
+	unsigned int juicerObject = scenePrep.add(juicerTransform, glm::vec3(-1.0f), glm::vec3(1.0f));
+	unsigned int saltObject = scenePrep.add(saltTransform, glm::vec3(-2.0f, -3.0f, -2.0f), glm::vec3(2.0f, 3.0f, 2.0f));
+	unsigned int saltTopObject = scenePrep.add(saltTopTransform, glm::vec3(-2.0f, -3.0f, -2.0f), glm::vec3(2.0f, 3.0f, 2.0f));
+
+	if (!staticBatches.build(staticScene, scenePrep))
+		std::cout << "Static scene does not fit in the GPU memory budget" << std::endl;
+	std::cout << "Static scene: " << staticBatches.objectCount() << " objects in " << staticScene.drawCount() << " batches, "
+		<< (staticScene.usesMultiDraw() ? "multi-draw indirect" : "fallback loop") << std::endl;
+
 	// load textures (we now use a utility function to keep the code more organized)
 	// -----------------------------------------------------------------------------
-	unsigned int diffuseMap1 = loadTexture("cheesegrater.png");
-	unsigned int diffuseMap2 = loadTexture("BlackPlastic.png");
-	unsigned int diffuseMap3 = loadTexture("GrayVinyl.png");
-	unsigned int specularMap = loadTexture("cheesegrater.png");
-	unsigned int specularMap2 = loadTexture("BlackPlastic.png");
-	unsigned int specularMap3 = loadTexture("GrayVinyl.png");
-	unsigned int diffuseMap4 = loadTexture("FlourTexture.png");
-	unsigned int specularMap4 = loadTexture("FlourTexture.png");
-	unsigned int diffuseMap5 = loadTexture("JuicerTexture.png");
-	unsigned int specularMap5 = loadTexture("JuicerTexture.png");
-	unsigned int diffuseMap6 = loadTexture("LidTexture.png");
-	unsigned int specularMap6 = loadTexture("LIdTexture.png");
-	unsigned int diffuseMap7 = loadTexture("SaltTexture.png");
-	unsigned int specularMap7 = loadTexture("SaltTexture.png");
+	GpuHandle diffuseMap1 = loadTexture("cheesegrater.png");
+	GpuHandle diffuseMap2 = loadTexture("BlackPlastic.png");
+	GpuHandle diffuseMap3 = loadTexture("GrayVinyl.png");
+	GpuHandle specularMap = loadTexture("cheesegrater.png");
+	GpuHandle specularMap2 = loadTexture("BlackPlastic.png");
+	GpuHandle specularMap3 = loadTexture("GrayVinyl.png");
+	GpuHandle diffuseMap4 = loadTexture("FlourTexture.png");
+	GpuHandle specularMap4 = loadTexture("FlourTexture.png");
+	GpuHandle diffuseMap5 = loadTexture("JuicerTexture.png");
+	GpuHandle specularMap5 = loadTexture("JuicerTexture.png");
+	GpuHandle diffuseMap6 = loadTexture("LidTexture.png");
+	GpuHandle specularMap6 = loadTexture("LIdTexture.png");
+	GpuHandle diffuseMap7 = loadTexture("SaltTexture.png");
+	GpuHandle specularMap7 = loadTexture("SaltTexture.png");
+
+	// material tables for the indirect scene; the index is the per-draw material attribute
+	const unsigned int NR_MATERIALS = 7;
+	unsigned int diffuseMaps[NR_MATERIALS] = { diffuseMap1, diffuseMap2, diffuseMap3, diffuseMap4, diffuseMap5, diffuseMap6, diffuseMap7 };
+	unsigned int specularMaps[NR_MATERIALS] = { specularMap, specularMap2, specularMap3, specularMap4, specularMap5, specularMap6, specularMap7 };
 
 	// shader configuration
 	// --------------------
+	// units 0-13 hold every material for the indirect draw and never change,
+	// the objects still drawn one at a time swap their maps on units 14 and 15
+	indirectShader.use();
+	for (unsigned int i = 0; i < NR_MATERIALS; i++)
+	{
+		indirectShader.setInt("diffuseMaps[" + std::to_string(i) + "]", i);
+		indirectShader.setInt("specularMaps[" + std::to_string(i) + "]", NR_MATERIALS + i);
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, diffuseMaps[i]);
+		glActiveTexture(GL_TEXTURE0 + NR_MATERIALS + i);
+		glBindTexture(GL_TEXTURE_2D, specularMaps[i]);
+	}
+
 	lightingShader.use();
-	lightingShader.setInt("material.diffuse", 0);
-	lightingShader.setInt("material.specular", 1);
+	lightingShader.setInt("material.diffuse", 2 * NR_MATERIALS);
+	lightingShader.setInt("material.specular", 2 * NR_MATERIALS + 1);
+
+	// the salt shaker body and top are the same cylinder at different scales; build it once
+	// here rather than every frame, which leaked a set of GL buffers per frame
+	static_meshes_3D::Cylinder saltCylinder(2, 20, 3, true, true, true);
+
+	// the scene is drawn offscreen at a scale that holds TARGET_FRAME_MS, then upscaled to the window;
+	// its texture goes on the first unit after the material and per-object maps
+	DynamicResolution dynamicResolution(TARGET_FRAME_MS);
+	dynamicResolution.init(upscaleShader, 2 * NR_MATERIALS + 2);
+	float shownScale = dynamicResolution.scale();
+
+	// per-frame scene preparation fans out over these threads; the GL thread only uploads and submits
+	JobSystem jobs;
+	std::cout << "Job system: " << jobs.threadCount() << " threads" << std::endl;
+
+	// binds one object's maps for the lighting shader
+	auto bindObjectMaps = [&](unsigned int diffuse, unsigned int specular)
+	{
+		glActiveTexture(GL_TEXTURE0 + 2 * NR_MATERIALS);
+		glBindTexture(GL_TEXTURE_2D, diffuse);
+		glActiveTexture(GL_TEXTURE0 + 2 * NR_MATERIALS + 1);
+		glBindTexture(GL_TEXTURE_2D, specular);
+		renderCounters.stateChanges += 2;
+	};
+
+	// draws the whole scene into the bound framebuffer; shared by the render loop and the tiled capture
+	auto drawScene = [&](const glm::mat4& projection)
+	{
+		glm::mat4 view = camera.GetViewMatrix();
+
+		// re-bake a static batch only after one of its objects was edited
+		if (staticBatches.isDirty())
+			staticBatches.build(staticScene, scenePrep);
+
+		// transforms, culling and the indirect draw list for this view, built on the job system;
+		// the upload is skipped unless a draw's visibility or transform changed
+		scenePrep.prepare(jobs, projection * view);
+		staticScene.upload();
+
+		// static scene: grater, handle, mat, flour, lid and juicer handle, four batches in one submission
+		indirectShader.use();
+		renderCounters.stateChanges++;
+		indirectShader.setVec3("viewPos", camera.Position);
+		indirectShader.setFloat("shininess", 32.0f);
+		setLightingUniforms(indirectShader, pointLightPositions);
+		indirectShader.setMat4("projection", projection);
+		indirectShader.setMat4("view", view);
+
+		staticScene.draw();
+		renderCounters.drawCalls += staticScene.submissionCount();
+		renderCounters.stateChanges++;
+
+		// the sphere and cylinders own their buffers, so they are still drawn one at a time
+		lightingShader.use();
+		renderCounters.stateChanges++;
+		lightingShader.setVec3("viewPos", camera.Position);
+		lightingShader.setFloat("material.shininess", 32.0f);
+		setLightingUniforms(lightingShader, pointLightPositions);
+		lightingShader.setMat4("projection", projection);
+		lightingShader.setMat4("view", view);
+
+		if (scenePrep.isVisible(juicerObject))
+		{
+			bindObjectMaps(diffuseMap5, specularMap5);
+			lightingShader.setMat4("model", scenePrep.model(juicerObject));
+
+			juicer.Draw();
+			renderCounters.drawCalls++;
+			renderCounters.stateChanges++;
+		}
 
+		if (scenePrep.isVisible(saltObject))
+		{
+			bindObjectMaps(diffuseMap7, specularMap7);
+			lightingShader.setMat4("model", scenePrep.model(saltObject));
+
+			saltCylinder.render();
+			renderCounters.drawCalls++;
+			renderCounters.stateChanges++;
+		}
+
+		if (scenePrep.isVisible(saltTopObject))
+		{
+			bindObjectMaps(diffuseMap6, specularMap6);
+			lightingShader.setMat4("model", scenePrep.model(saltTopObject));
+
+			saltCylinder.render();
+			renderCounters.drawCalls++;
+			renderCounters.stateChanges++;
+		}
+	};
+
+	TiledCapture tiledCapture;
+	double lastSwapTime = 0.0;
 
 	// render loop
 	// -----------
 	while (!glfwWindowShouldClose(window))
 	{
+		// idle: sleep until an event arrives instead of redrawing an unchanged frame
+		bool idle = !sceneInvalidated && !movementKeyHeld;
+		if (renderOnDemand && idle)
+		{
+			glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+			lastFrame = glfwGetTime();		// the time spent asleep is not camera movement
+		}
+
 		// per-frame time logic
 		// --------------------
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		if (benchmarkMode != BENCH_OFF)
+			deltaTime = BENCH_DELTA_TIME;
 
 		// input
 		// -----
 		processInput(window);
 
+		if (jobStatsRequested)
+		{
+			jobStatsRequested = false;
+			JobSystem::Stats stats = jobs.stats();
+			std::cout << "Job system: " << stats.executed << " tasks, " << stats.steals << " steals in "
+				<< stats.stealAttempts << " attempts, " << stats.idleMs << " ms of worker time idle inside graphs" << std::endl;
+			jobs.resetStats();
+		}
+
+		if (turnFlourRequested)
+		{
+			turnFlourRequested = false;
+			staticBatches.edit(flourObject).angle += 15.0f;
+			sceneInvalidated = true;
+		}
+
+		// poster-size capture of the current view, rendered tile by tile
+		if (captureRequested && fbWidth > 0 && fbHeight > 0)
+		{
+			captureRequested = false;
+			int captureHeight = (int)((long long)CAPTURE_WIDTH * fbHeight / fbWidth);
+			tiledCapture.capture(CAPTURE_PATH, CAPTURE_WIDTH, captureHeight, sceneProjection((float)CAPTURE_WIDTH / captureHeight), drawScene);
+			lastFrame = glfwGetTime();		// the capture time is not camera movement
+		}
+
+		// woke up (timeout or an event that changed nothing visible): go back to sleep
+		if (renderOnDemand && !sceneInvalidated)
+			continue;
+		sceneInvalidated = false;
+
+		// nothing to draw into while minimized; the swap below is skipped too, so wait for
+		// events here or continuous mode would spin without ever seeing the restore
+		if (fbWidth == 0 || fbHeight == 0)
+		{
+			glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+			continue;
+		}
+
+		if (dynamicResolution.isEnabled() != useDynamicResolution)
+			dynamicResolution.setEnabled(useDynamicResolution);
+		dynamicResolution.begin(fbWidth, fbHeight);
+		renderCounters.reset();
+
 		// render
 		// ------
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// be sure to activate shader when setting uniforms/drawing objects
-		lightingShader.use();
-		lightingShader.setVec3("viewPos", camera.Position);
-		lightingShader.setFloat("material.shininess", 32.0f);
+		// view/projection transformations, following the real framebuffer's aspect ratio
+		glm::mat4 projection = sceneProjection((float)fbWidth / (float)fbHeight);
+		drawScene(projection);
 
-		/*
-		   Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
-		   the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
-		   by defining light types as classes and set their values in there, or by using a more efficient uniform approach
-		   by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
-		*/
-		// directional light
-		lightingShader.setVec3("dirLight.direction", 0.0f, -1.0f, 0.0f);
-		lightingShader.setVec3("dirLight.ambient", 0.5f, 0.5f, 0.5f);
-		lightingShader.setVec3("dirLight.diffuse", 1.0f, 01.0f, 1.0f);
-		lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-		// point light 1
-		lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-		lightingShader.setVec3("pointLights[0].ambient", 0.1f, 0.1f, 0.1f);
-		lightingShader.setVec3("pointLights[0].diffuse", 0.5f, 0.5f, 0.2f);
-		lightingShader.setVec3("pointLights[0].specular", 0.5f, 0.5f, 0.2f);
-		lightingShader.setFloat("pointLights[0].constant", 1.0f);
-		lightingShader.setFloat("pointLights[0].linear", 0.09);
-		lightingShader.setFloat("pointLights[0].quadratic", 0.032);
-		// point light 2
-		lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-		lightingShader.setVec3("pointLights[1].ambient", 0.1f, 0.1f, 0.1f);
-		lightingShader.setVec3("pointLights[1].diffuse", 0.5f, 0.5f, 0.2f);
-		lightingShader.setVec3("pointLights[1].specular", 0.5f, 0.5f, 0.2f);
-		lightingShader.setFloat("pointLights[1].constant", 1.0f);
-		lightingShader.setFloat("pointLights[1].linear", 0.09);
-		lightingShader.setFloat("pointLights[1].quadratic", 0.032);
-		// point light 3
-		lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-		lightingShader.setVec3("pointLights[2].ambient", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("pointLights[2].diffuse", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("pointLights[2].specular", 0.0f, 0.0f, 0.0f);
-		lightingShader.setFloat("pointLights[2].constant", 1.0f);
-		lightingShader.setFloat("pointLights[2].linear", 0.09);
-		lightingShader.setFloat("pointLights[2].quadratic", 0.032);
-		// point light 4
-		lightingShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-		lightingShader.setVec3("pointLights[3].ambient", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("pointLights[3].diffuse", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("pointLights[3].specular", 0.0f, 0.0f, 0.0f);
-		lightingShader.setFloat("pointLights[3].constant", 1.0f);
-		lightingShader.setFloat("pointLights[3].linear", 0.09);
-		lightingShader.setFloat("pointLights[3].quadratic", 0.032);
-		// spotLight
-		lightingShader.setVec3("spotLight.position", camera.Position);
-		lightingShader.setVec3("spotLight.direction", camera.Front);
-		lightingShader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
-		lightingShader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
-		lightingShader.setFloat("spotLight.constant", 1.0f);
-		lightingShader.setFloat("spotLight.linear", 0.09);
-		lightingShader.setFloat("spotLight.quadratic", 0.032);
-		lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
-
-		// view/projection transformations
-		glm::mat4 projection;
-		if (useOrtho == true)
-		{
-			float scale = 100;
-			projection = glm::ortho(-((float)SCR_WIDTH / scale), ((float)SCR_WIDTH / scale), -((float)SCR_HEIGHT / scale), ((float)SCR_HEIGHT / scale), -5.0f, 100.0f);
-		}
-		else
+		dynamicResolution.end();
+
+		// show the current resolution scale in the title bar
+		if (dynamicResolution.scale() != shownScale)
 		{
-			projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+			shownScale = dynamicResolution.scale();
+			std::string title = "LearnOpenGL - " + std::to_string((int)std::lround(shownScale * 100)) + "% resolution";
+			glfwSetWindowTitle(window, title.c_str());
 		}
-		
-		glm::mat4 view = camera.GetViewMatrix();
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
 
-		// world transformation
-		glm::mat4 model = glm::mat4(1.0f);
-		lightingShader.setMat4("model", model);
-
-		// bind diffuse map
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap1);
-
-		// bind diffuse map
-		
-
-		// bind specular map
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap);
-
-		// render containers
-		glBindVertexArray(graterVAO);
-		//for (unsigned int i = 0; i < 1; i++)
-		//{
-			// calculate the model matrix for each object and pass it to shader before drawing
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[0]);
-			model = glm::scale(model, glm::vec3(2.0f, 3.0f, 1.0f));
-			float angle = 20.0f * 0;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			lightingShader.setMat4("model", model);
-
-			glDrawArrays(GL_TRIANGLES, 0, graterVerts);
-		//}
-
-		// also draw the lamp object(s)
-		/*lightCubeShader.use();
-		lightCubeShader.setMat4("projection", projection);
-		lightCubeShader.setMat4("view", view);*/
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap2);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap2);
-
-		// we now draw as many light bulbs as we have point lights.
-		glBindVertexArray(handleVAO);
-		//for (unsigned int i = 0; i < 0; i++)
-		//{
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[0]);
-			model = glm::scale(model, glm::vec3(2.0f, 3.0f, 1.0f));
-			angle = 20.0f * 0;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			lightingShader.setMat4("model", model);
-			glDrawArrays(GL_TRIANGLES, 0, handleVerts);
-		//}
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap3);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap3);
-
-		// we now draw as many light bulbs as we have point lights.
-		glBindVertexArray(matVAO);
-		//for (unsigned int i = 0; i < 0; i++)
-		//{
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[0]);
-		model = glm::scale(model, glm::vec3(2.0f, 3.0f, 1.0f));
-		angle = 20.0f * 0;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		lightingShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, matVerts);
-		//}
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap4);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap4);
-
-		glBindVertexArray(flourVAO);
-		//for (unsigned int i = 0; i < 0; i++)
-		//{
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[1]);
-		model = glm::scale(model, glm::vec3(2.5f, 2.5f, 2.5f));
-		angle = 20.0f * 2;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightingShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, flourVerts);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap6);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap6);
-
-		glBindVertexArray(lidVAO);
-		//for (unsigned int i = 0; i < 0; i++)
-		//{
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[2]);
-		model = glm::scale(model, glm::vec3(2.65f, 0.5f, 2.65f));
-		angle = 20.0f * 2;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightingShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, lidVerts);
-
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap5);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap5);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[3]);
-		model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-		angle = 20.0f * 0;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		lightingShader.setMat4("model", model);
-
-		juicer.Draw();
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap5);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap5);
-
-		glBindVertexArray(juicerVAO);
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[4]);
-		model = glm::scale(model, glm::vec3(4.0f, 0.5f, 0.3f));
-		angle = 20.0f * 0;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		lightingShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, juicerHandleVerts);
-
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap7);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap7);
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[5]);
-		model = glm::scale(model, glm::vec3(0.5f, 0.8f, 0.5f));
-		angle = 20.0f * 0;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		lightingShader.setMat4("model", model);
-
-		static_meshes_3D::Cylinder salt(2, 20, 3, true, true, true);
-		salt.render();
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap6);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap6);
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, cubePositions[5]);
-		model = glm::scale(model, glm::vec3(0.49f, 1.0f, 0.49f));
-		angle = 20.0f * 0;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		lightingShader.setMat4("model", model);
-
-		static_meshes_3D::Cylinder saltTop(2, 20, 3, true, true, true);
-		saltTop.render();
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		// -------------------------------------------------------------------------------
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		// replays measure swap-to-swap time; the first frame only sets the start.
+		// GPU times are whatever timer results this frame's begin() collected, possibly none
+		if (benchmarkMode == BENCH_REPLAY)
+		{
+			benchmarkReport.addGpuTimes(dynamicResolution.collectedGpuTimes());
+			double swapTime = glfwGetTime();
+			if (lastSwapTime > 0.0)
+				benchmarkReport.addFrame((float)((swapTime - lastSwapTime) * 1000.0), renderCounters);
+			lastSwapTime = swapTime;
+		}
 	}
 
-	// optional: de-allocate all resources once they've outlived their purpose:
-	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &graterVAO);
-	glDeleteVertexArrays(1, &handleVAO);
-	glDeleteBuffers(1, &graterVBO);
-	glDeleteBuffers(1, &handleVBO);
-	glDeleteVertexArrays(1, &matVAO);
-	glDeleteBuffers(1, &matVBO);
-	glDeleteVertexArrays(1, &flourVAO);
-	glDeleteBuffers(1, &flourVBO);
-	glDeleteVertexArrays(1, &lidVAO);
-	glDeleteBuffers(1, &lidVBO);
-	// glfw: terminate, clearing all previously allocated GLFW resources.
-	// ------------------------------------------------------------------
-	glfwTerminate();
+	if (benchmarkMode == BENCH_REPLAY)
+	{
+		std::cout << "Benchmark replay of " << pathPlayer.size() << " frames:" << std::endl;
+		benchmarkReport.print(std::cout);
+		if (!benchmarkReport.write(benchmarkReportPath))
+			std::cout << "Cannot write benchmark report " << benchmarkReportPath << std::endl;
+	}
+}
+
+// synthetic large scene for measuring how scene preparation scales with threads;
+// runs without a window and prints the average prep time per frame for each thread count
+// ---------------------------------------------------------------------------------------
+int runPrepBenchmark(size_t objectCount)
+{
+	const int FRAMES = 50;
+
+	// objects scattered through a cube around the camera, so the frustum keeps a fraction of them
+	ScenePrep prep(1024);
+	srand(1);
+	for (size_t i = 0; i < objectCount; i++)
+	{
+		glm::vec3 position(rand() % 400 - 200.0f, rand() % 400 - 200.0f, rand() % 400 - 200.0f);
+		glm::vec3 scale(0.5f + rand() % 100 / 50.0f);
+		prep.add(SceneTransform(position, scale, (float)(rand() % 360), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(-0.5f), glm::vec3(0.5f));
+	}
+	glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	double singleThreadMs = 0.0;
+	std::cout << "Scene prep of " << objectCount << " objects, " << FRAMES << " frames per run" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		JobSystem jobs(threads - 1);
+		prep.prepare(jobs, viewProjection);		// warm up caches and wake the workers
+		jobs.resetStats();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < FRAMES; frame++)
+			prep.prepare(jobs, viewProjection);
+		double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / FRAMES;
+		if (threads == 1)
+			singleThreadMs = frameMs;
+
+		JobSystem::Stats stats = jobs.stats();
+		std::cout << "  " << std::setw(3) << threads << " threads " << std::setw(9) << frameMs << " ms/frame  "
+			<< std::setw(6) << singleThreadMs / frameMs << "x  " << std::setw(7) << stats.steals / FRAMES << " steals/frame  "
+			<< std::setw(8) << stats.idleMs / FRAMES << " ms idle/frame" << std::endl;
+
+		if (threads == maxThreads)
+			break;
+	}
 	return 0;
 }
 
@@ -743,26 +811,154 @@ int main()
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window)
 {
-	float cameraOffset = camera.MovementSpeed * deltaTime;		// Calculate amount of camera movement with current camera movement sensitivity
-
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
 
+	// a replay takes the place of the live keyboard and mouse, and ends the run when it runs out
+	if (benchmarkMode == BENCH_REPLAY)
+	{
+		InputFrame input;
+		CameraState recorded;
+		if (!pathPlayer.next(input, recorded))
+		{
+			glfwSetWindowShouldClose(window, true);
+			return;
+		}
+		input.deltaTime = deltaTime;
+		applyInput(input);
+		benchmarkReport.addDrift(cameraState(), recorded);
+		return;
+	}
+
+	InputFrame input;
+	input.deltaTime = deltaTime;
+	input.keys = 0;
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
+		input.keys |= INPUT_FORWARD;
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
+		input.keys |= INPUT_BACKWARD;
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.ProcessKeyboard(LEFT, deltaTime);
+		input.keys |= INPUT_LEFT;
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+		input.keys |= INPUT_RIGHT;
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)			// 'Q' key now pans up
-		camera.Position += camera.Up * cameraOffset;			// modify Up vector of camera position by camera offset
+		input.keys |= INPUT_UP;
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)			// 'E' key pans down
-		camera.Position -= camera.Up * cameraOffset;			// modify Up vector of camera position by camera offset
-
+		input.keys |= INPUT_DOWN;
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)			//Toggle Perspective
+		input.keys |= INPUT_TOGGLE_ORTHO;
+	input.mouseX = pendingMouseX;
+	input.mouseY = pendingMouseY;
+	input.scroll = pendingScroll;
+	pendingMouseX = pendingMouseY = pendingScroll = 0.0f;
+
+	applyInput(input);
+	if (benchmarkMode == BENCH_RECORD)
+		pathRecorder.write(input, cameraState());
+
+	// held movement keys change the camera every frame, so keep rendering until they are released
+	movementKeyHeld = (input.keys & (INPUT_FORWARD | INPUT_BACKWARD | INPUT_LEFT | INPUT_RIGHT | INPUT_UP | INPUT_DOWN)) != 0;
+
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)			// toggle render on demand / continuous rendering
+	{
+		if (!onDemandKeyHeld)
+		{
+			renderOnDemand = !renderOnDemand;
+			std::cout << (renderOnDemand ? "Rendering on demand" : "Rendering continuously") << std::endl;
+		}
+		onDemandKeyHeld = true;
+	}
+	else
+		onDemandKeyHeld = false;
+
+	if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS)			// toggle dynamic resolution
+	{
+		if (!dynamicResolutionKeyHeld)
+		{
+			useDynamicResolution = !useDynamicResolution;
+			sceneInvalidated = true;
+		}
+		dynamicResolutionKeyHeld = true;
+	}
+	else
+		dynamicResolutionKeyHeld = false;
+
+	if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS)			// capture the view at CAPTURE_WIDTH
+	{
+		if (!captureKeyHeld)
+			captureRequested = true;
+		captureKeyHeld = true;
+	}
+	else
+		captureKeyHeld = false;
+
+	if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS)			// print live GPU resources once per press
+	{
+		if (!reportKeyHeld)
+			gpuResources().report(std::cout);
+		reportKeyHeld = true;
+	}
+	else
+		reportKeyHeld = false;
+
+	if (glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS)			// print job system statistics since the last press
+	{
+		if (!jobStatsKeyHeld)
+			jobStatsRequested = true;
+		jobStatsKeyHeld = true;
+	}
+	else
+		jobStatsKeyHeld = false;
+
+	if (glfwGetKey(window, GLFW_KEY_F4) == GLFW_PRESS)			// turn the flour bag a little
+	{
+		if (!turnFlourKeyHeld)
+			turnFlourRequested = true;
+		turnFlourKeyHeld = true;
+	}
+	else
+		turnFlourKeyHeld = false;
+}
+
+// moves the camera for one frame of input, live or replayed
+// ---------------------------------------------------------
+void applyInput(const InputFrame& input)
+{
+	float cameraOffset = camera.MovementSpeed * input.deltaTime;		// Calculate amount of camera movement with current camera movement sensitivity
+
+	if (input.keys & INPUT_FORWARD)
+		camera.ProcessKeyboard(FORWARD, input.deltaTime);
+	if (input.keys & INPUT_BACKWARD)
+		camera.ProcessKeyboard(BACKWARD, input.deltaTime);
+	if (input.keys & INPUT_LEFT)
+		camera.ProcessKeyboard(LEFT, input.deltaTime);
+	if (input.keys & INPUT_RIGHT)
+		camera.ProcessKeyboard(RIGHT, input.deltaTime);
+	if (input.keys & INPUT_UP)
+		camera.Position += camera.Up * cameraOffset;			// modify Up vector of camera position by camera offset
+	if (input.keys & INPUT_DOWN)
+		camera.Position -= camera.Up * cameraOffset;			// modify Up vector of camera position by camera offset
+	if (input.keys & INPUT_TOGGLE_ORTHO)
 		useOrtho = !useOrtho;
+
+	if (input.mouseX != 0.0f || input.mouseY != 0.0f)
+		camera.ProcessMouseMovement(input.mouseX, input.mouseY);
+	if (input.scroll != 0.0f)
+		camera.MovementSpeed += input.scroll;	// increases or decreases camera movement speed by amount of scroll wheel inuput
+
+	if (input.keys != 0 || input.mouseX != 0.0f || input.mouseY != 0.0f || input.scroll != 0.0f)
+		sceneInvalidated = true;
+}
+
+CameraState cameraState()
+{
+	CameraState state;
+	state.position = camera.Position;
+	state.yaw = camera.Yaw;
+	state.pitch = camera.Pitch;
+	state.movementSpeed = camera.MovementSpeed;
+	state.ortho = useOrtho;
+	return state;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -772,6 +968,16 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	// make sure the viewport matches the new window dimensions; note that width and 
 	// height will be significantly larger than specified on retina displays.
 	glViewport(0, 0, width, height);
+	fbWidth = width;
+	fbHeight = height;
+	sceneInvalidated = true;
+}
+
+// glfw: whenever the window contents need redrawing (uncovered, restored), this callback is called
+// -----------------------------------------------------------------------------------------------
+void window_refresh_callback(GLFWwindow* window)
+{
+	sceneInvalidated = true;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -791,7 +997,9 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	lastX = xpos;
 	lastY = ypos;
 
-	camera.ProcessMouseMovement(xoffset, yoffset);
+	pendingMouseX += xoffset;
+	pendingMouseY += yoffset;
+	sceneInvalidated = true;
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
@@ -799,15 +1007,15 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	//camera.ProcessMouseScroll(yoffset);
-	camera.MovementSpeed += yoffset;	// increases or decreases camera movement speed by amount of scroll wheel inuput
+	pendingScroll += yoffset;			// applied to the movement speed by applyInput
+	sceneInvalidated = true;
 }
 
 // utility function for loading a 2D texture from file
 // ---------------------------------------------------
-unsigned int loadTexture(char const * path)
+GpuHandle loadTexture(char const * path)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+	GpuHandle textureID = gpuResources().createTexture(path);
 
 	int width, height, nrComponents;
 	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
@@ -821,6 +1029,14 @@ unsigned int loadTexture(char const * path)
 		else if (nrComponents == 4)
 			format = GL_RGBA;
 
+		// drivers pad RGB to 4 bytes per texel; the mip chain adds another third
+		size_t bytes = (size_t)width * height * (nrComponents == 1 ? 1 : 4) * 4 / 3;
+		if (!textureID.track(bytes))
+		{
+			stbi_image_free(data);
+			return textureID;
+		}
+
 		glBindTexture(GL_TEXTURE_2D, textureID);
 		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
@@ -839,4 +1055,77 @@ unsigned int loadTexture(char const * path)
 	}
 
 	return textureID;
-}
\ No newline at end of file
+}
+
+// sets the light uniforms shared by the lighting shaders
+// -------------------------------------------------------
+void setLightingUniforms(Shader& shader, const glm::vec3* pointLightPositions)
+{
+	/*
+	   Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
+	   the proper PointLight struct in the array to set each uniform variable. This can be done more code-friendly
+	   by defining light types as classes and set their values in there, or by using a more efficient uniform approach
+	   by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
+	*/
+	// directional light
+	shader.setVec3("dirLight.direction", 0.0f, -1.0f, 0.0f);
+	shader.setVec3("dirLight.ambient", 0.5f, 0.5f, 0.5f);
+	shader.setVec3("dirLight.diffuse", 1.0f, 01.0f, 1.0f);
+	shader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+	// point light 1
+	shader.setVec3("pointLights[0].position", pointLightPositions[0]);
+	shader.setVec3("pointLights[0].ambient", 0.1f, 0.1f, 0.1f);
+	shader.setVec3("pointLights[0].diffuse", 0.5f, 0.5f, 0.2f);
+	shader.setVec3("pointLights[0].specular", 0.5f, 0.5f, 0.2f);
+	shader.setFloat("pointLights[0].constant", 1.0f);
+	shader.setFloat("pointLights[0].linear", 0.09);
+	shader.setFloat("pointLights[0].quadratic", 0.032);
+	// point light 2
+	shader.setVec3("pointLights[1].position", pointLightPositions[1]);
+	shader.setVec3("pointLights[1].ambient", 0.1f, 0.1f, 0.1f);
+	shader.setVec3("pointLights[1].diffuse", 0.5f, 0.5f, 0.2f);
+	shader.setVec3("pointLights[1].specular", 0.5f, 0.5f, 0.2f);
+	shader.setFloat("pointLights[1].constant", 1.0f);
+	shader.setFloat("pointLights[1].linear", 0.09);
+	shader.setFloat("pointLights[1].quadratic", 0.032);
+	// point light 3
+	shader.setVec3("pointLights[2].position", pointLightPositions[2]);
+	shader.setVec3("pointLights[2].ambient", 0.0f, 0.0f, 0.0f);
+	shader.setVec3("pointLights[2].diffuse", 0.0f, 0.0f, 0.0f);
+	shader.setVec3("pointLights[2].specular", 0.0f, 0.0f, 0.0f);
+	shader.setFloat("pointLights[2].constant", 1.0f);
+	shader.setFloat("pointLights[2].linear", 0.09);
+	shader.setFloat("pointLights[2].quadratic", 0.032);
+	// point light 4
+	shader.setVec3("pointLights[3].position", pointLightPositions[3]);
+	shader.setVec3("pointLights[3].ambient", 0.0f, 0.0f, 0.0f);
+	shader.setVec3("pointLights[3].diffuse", 0.0f, 0.0f, 0.0f);
+	shader.setVec3("pointLights[3].specular", 0.0f, 0.0f, 0.0f);
+	shader.setFloat("pointLights[3].constant", 1.0f);
+	shader.setFloat("pointLights[3].linear", 0.09);
+	shader.setFloat("pointLights[3].quadratic", 0.032);
+	// spotLight
+	shader.setVec3("spotLight.position", camera.Position);
+	shader.setVec3("spotLight.direction", camera.Front);
+	shader.setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
+	shader.setVec3("spotLight.diffuse", 0.0f, 0.0f, 0.0f);
+	shader.setVec3("spotLight.specular", 0.0f, 0.0f, 0.0f);
+	shader.setFloat("spotLight.constant", 1.0f);
+	shader.setFloat("spotLight.linear", 0.09);
+	shader.setFloat("spotLight.quadratic", 0.032);
+	shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+	shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+}
+
+// projection for the current perspective/ortho mode at the given aspect ratio
+// ---------------------------------------------------------------------------
+glm::mat4 sceneProjection(float aspect)
+{
+	if (useOrtho == true)
+	{
+		float scale = 100;
+		float halfHeight = (float)SCR_HEIGHT / scale;
+		return glm::ortho(-halfHeight * aspect, halfHeight * aspect, -halfHeight, halfHeight, -5.0f, 100.0f);
+	}
+	return glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+}
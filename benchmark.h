@@ -0,0 +1,309 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+// bits of InputFrame::keys
+enum InputKeys {
+	INPUT_FORWARD = 1 << 0,
+	INPUT_BACKWARD = 1 << 1,
+	INPUT_LEFT = 1 << 2,
+	INPUT_RIGHT = 1 << 3,
+	INPUT_UP = 1 << 4,
+	INPUT_DOWN = 1 << 5,
+	INPUT_TOGGLE_ORTHO = 1 << 6
+};
+
+// everything that moves the camera during one frame
+struct InputFrame
+{
+	float deltaTime;
+	unsigned int keys;
+	float mouseX, mouseY;		// mouse offsets accumulated since the last frame
+	float scroll;
+};
+
+// camera state after a frame's input has been applied, recorded to check replays
+struct CameraState
+{
+	glm::vec3 position;
+	float yaw, pitch;
+	float movementSpeed;
+	bool ortho;
+};
+
+// per-frame draw calls and state changes (shader, VAO and texture binds), reset every frame
+struct RenderCounters
+{
+	unsigned int drawCalls;
+	unsigned int stateChanges;
+
+	RenderCounters() : drawCalls(0), stateChanges(0)
+	{
+	}
+
+	void reset()
+	{
+		drawCalls = 0;
+		stateChanges = 0;
+	}
+};
+
+// Camera path file: a header line, then one line per frame with the input
+// and the camera state it produced. Plain text so paths can be diffed.
+class CameraPathRecorder
+{
+public:
+	bool open(const std::string& path)
+	{
+		file.open(path.c_str());
+		if (!file)
+			return false;
+		file << "camera-path 1" << std::endl;
+		file << std::setprecision(9);
+		return true;
+	}
+
+	void write(const InputFrame& input, const CameraState& state)
+	{
+		file << input.deltaTime << ' ' << input.keys << ' ' << input.mouseX << ' ' << input.mouseY << ' ' << input.scroll << ' '
+			<< state.position.x << ' ' << state.position.y << ' ' << state.position.z << ' '
+			<< state.yaw << ' ' << state.pitch << ' ' << state.movementSpeed << ' ' << (state.ortho ? 1 : 0) << '\n';
+	}
+
+private:
+	std::ofstream file;
+};
+
+class CameraPathPlayer
+{
+public:
+	CameraPathPlayer() : cursor(0)
+	{
+	}
+
+	bool load(const std::string& path)
+	{
+		std::ifstream file(path.c_str());
+		std::string magic;
+		int version = 0;
+		if (!(file >> magic >> version) || magic != "camera-path" || version != 1)
+			return false;
+
+		Frame frame;
+		int ortho;
+		while (file >> frame.input.deltaTime >> frame.input.keys >> frame.input.mouseX >> frame.input.mouseY >> frame.input.scroll
+			>> frame.state.position.x >> frame.state.position.y >> frame.state.position.z
+			>> frame.state.yaw >> frame.state.pitch >> frame.state.movementSpeed >> ortho)
+		{
+			frame.state.ortho = ortho != 0;
+			frames.push_back(frame);
+		}
+		cursor = 0;
+		return !frames.empty();
+	}
+
+	// fetch the next recorded frame; false once the path is exhausted
+	bool next(InputFrame& input, CameraState& expected)
+	{
+		if (cursor >= frames.size())
+			return false;
+		input = frames[cursor].input;
+		expected = frames[cursor].state;
+		cursor++;
+		return true;
+	}
+
+	size_t size() const
+	{
+		return frames.size();
+	}
+
+private:
+	struct Frame
+	{
+		InputFrame input;
+		CameraState state;
+	};
+
+	std::vector<Frame> frames;
+	size_t cursor;
+};
+
+// Collects per-frame measurements of a replay and writes them as flat
+// "metric -> value" JSON or CSV, picked by the file extension.
+class BenchmarkReport
+{
+public:
+	BenchmarkReport() : drawCalls(0), stateChanges(0), cameraDrift(0.0f)
+	{
+	}
+
+	void addFrame(float frameMs, const RenderCounters& counters)
+	{
+		frameTimes.push_back(frameMs);
+		drawCalls += counters.drawCalls;
+		stateChanges += counters.stateChanges;
+	}
+
+	// GPU times arrive from timer queries a few frames late and not one per frame, so they are added as they are read
+	void addGpuTimes(const std::vector<float>& gpuMs)
+	{
+		gpuTimes.insert(gpuTimes.end(), gpuMs.begin(), gpuMs.end());
+	}
+
+	// how far the replayed camera ended up from the recorded one
+	void addDrift(const CameraState& replayed, const CameraState& recorded)
+	{
+		cameraDrift = std::max(cameraDrift, glm::length(replayed.position - recorded.position));
+	}
+
+	std::vector<std::pair<std::string, double> > metrics() const
+	{
+		std::vector<std::pair<std::string, double> > result;
+		double frames = (double)frameTimes.size();
+		double mean = 0.0;
+		for (size_t i = 0; i < frameTimes.size(); i++)
+			mean += frameTimes[i];
+
+		result.push_back(std::make_pair("frames", frames));
+		result.push_back(std::make_pair("frame_ms_mean", frames > 0 ? mean / frames : 0.0));
+		result.push_back(std::make_pair("frame_ms_p50", percentile(frameTimes, 50.0)));
+		result.push_back(std::make_pair("frame_ms_p95", percentile(frameTimes, 95.0)));
+		result.push_back(std::make_pair("frame_ms_p99", percentile(frameTimes, 99.0)));
+		result.push_back(std::make_pair("frame_ms_max", percentile(frameTimes, 100.0)));
+		result.push_back(std::make_pair("gpu_ms_p50", percentile(gpuTimes, 50.0)));
+		result.push_back(std::make_pair("gpu_ms_p95", percentile(gpuTimes, 95.0)));
+		result.push_back(std::make_pair("gpu_ms_p99", percentile(gpuTimes, 99.0)));
+		result.push_back(std::make_pair("draw_calls_per_frame", frames > 0 ? drawCalls / frames : 0.0));
+		result.push_back(std::make_pair("state_changes_per_frame", frames > 0 ? stateChanges / frames : 0.0));
+		result.push_back(std::make_pair("camera_drift", cameraDrift));
+		return result;
+	}
+
+	bool write(const std::string& path) const
+	{
+		std::ofstream file(path.c_str());
+		if (!file)
+			return false;
+
+		std::vector<std::pair<std::string, double> > values = metrics();
+		file << std::setprecision(6);
+		if (endsWith(path, ".csv"))
+		{
+			file << "metric,value\n";
+			for (size_t i = 0; i < values.size(); i++)
+				file << values[i].first << ',' << values[i].second << '\n';
+		}
+		else
+		{
+			file << "{\n";
+			for (size_t i = 0; i < values.size(); i++)
+				file << "  \"" << values[i].first << "\": " << values[i].second << (i + 1 < values.size() ? ",\n" : "\n");
+			file << "}\n";
+		}
+		return (bool)file;
+	}
+
+	void print(std::ostream& out) const
+	{
+		std::vector<std::pair<std::string, double> > values = metrics();
+		for (size_t i = 0; i < values.size(); i++)
+			out << "  " << std::left << std::setw(26) << values[i].first << std::right << values[i].second << std::endl;
+	}
+
+	// nearest-rank percentile
+	static double percentile(std::vector<float> values, double p)
+	{
+		if (values.empty())
+			return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+		return values[std::min(std::max(rank, (size_t)1), values.size()) - 1];
+	}
+
+	// read a report written by write(), JSON or CSV
+	static bool read(const std::string& path, std::map<std::string, double>& values)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+			return false;
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			// both formats reduce to "name<separator>value" once quotes and braces are dropped
+			std::string name, text;
+			std::string::size_type separator = line.find_first_of(":,");
+			if (separator == std::string::npos)
+				continue;
+			for (std::string::size_type i = 0; i < separator; i++)
+				if (line[i] != '"' && line[i] != ' ')
+					name += line[i];
+			text = line.substr(separator + 1);
+
+			std::istringstream number(text);
+			double value;
+			if (!name.empty() && number >> value)
+				values[name] = value;
+		}
+		return !values.empty();
+	}
+
+	// flag metrics that got worse than the baseline by more than thresholdPercent;
+	// returns the number of regressions, or -1 if a report could not be read
+	static int compare(const std::string& baselinePath, const std::string& currentPath, double thresholdPercent, std::ostream& out)
+	{
+		std::map<std::string, double> baseline, current;
+		if (!read(baselinePath, baseline) || !read(currentPath, current))
+		{
+			out << "Cannot read benchmark reports " << baselinePath << " and " << currentPath << std::endl;
+			return -1;
+		}
+
+		int regressions = 0;
+		out << std::fixed << std::setprecision(3);
+		for (std::map<std::string, double>::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+		{
+			// every compared metric is lower-is-better; the frame count and drift are informational
+			if (it->first == "frames" || it->first == "camera_drift")
+				continue;
+			std::map<std::string, double>::const_iterator match = current.find(it->first);
+			if (match == current.end())
+				continue;
+
+			double change = it->second > 0.0 ? (match->second - it->second) / it->second * 100.0 : 0.0;
+			bool regressed = change > thresholdPercent;
+			if (regressed)
+				regressions++;
+			out << "  " << std::left << std::setw(26) << it->first << std::right << std::setw(12) << it->second
+				<< std::setw(12) << match->second << std::setw(9) << std::showpos << change << std::noshowpos << "%"
+				<< (regressed ? "  REGRESSION" : "") << std::endl;
+		}
+		out << regressions << " regression(s) beyond " << thresholdPercent << "%" << std::endl;
+		return regressions;
+	}
+
+private:
+	std::vector<float> frameTimes;
+	std::vector<float> gpuTimes;
+	double drawCalls;
+	double stateChanges;
+	float cameraDrift;
+
+	static bool endsWith(const std::string& text, const std::string& suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+};
+#endif
@@ -0,0 +1,249 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "gpu_resources.h"
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Renders the scene into an offscreen target whose resolution follows a
+// controller that holds a target GPU frame time, then upscales the result to
+// the window with a bilinear filter pass.
+//
+// The target is allocated once at the full window size and the scene is drawn
+// into its lower-left corner, so scale changes never reallocate GPU memory.
+// GPU time comes from GL_TIME_ELAPSED queries, read a few frames late so the
+// CPU never waits on them.
+class DynamicResolution
+{
+public:
+	float targetFrameMs;
+	float minScale;
+	float maxScale;
+
+	DynamicResolution(float targetFrameMs = 16.6f, float minScale = 0.5f, float maxScale = 1.0f)
+		: targetFrameMs(targetFrameMs), minScale(minScale), maxScale(maxScale), currentScale(maxScale), enabled(true),
+		outputWidth(0), outputHeight(0), renderWidth(0), renderHeight(0), offscreen(false),
+		smoothedMs(0.0f), framesSinceChange(0), nextQuery(0), timing(false)
+	{
+		for (unsigned int i = 0; i < QUERY_COUNT; i++)
+			queryPending[i] = false;
+	}
+
+	// create the GPU objects; the upscale shader samples its scene texture from sceneUnit
+	void init(Shader& upscale, unsigned int sceneUnit)
+	{
+		upscaleShader = &upscale;
+		textureUnit = sceneUnit;
+		emptyVAO = gpuResources().createVertexArray("upscale pass VAO");
+		for (unsigned int i = 0; i < QUERY_COUNT; i++)
+			queries[i] = gpuResources().createQuery("frame timer");
+
+		upscaleShader->use();
+		upscaleShader->setInt("scene", textureUnit);
+	}
+
+	// start a frame for a window framebuffer of the given size; binds the framebuffer to draw into
+	void begin(int windowWidth, int windowHeight)
+	{
+		collectedMs.clear();
+		collectTimings();
+
+		if (windowWidth != outputWidth || windowHeight != outputHeight)
+			allocate(windowWidth, windowHeight);
+
+		offscreen = enabled && fbo != 0;
+		if (offscreen)
+		{
+			renderWidth = std::max(1, (int)std::lround(outputWidth * currentScale));
+			renderHeight = std::max(1, (int)std::lround(outputHeight * currentScale));
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		}
+		else
+		{
+			renderWidth = outputWidth;
+			renderHeight = outputHeight;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+		glViewport(0, 0, renderWidth, renderHeight);
+
+		timing = !queryPending[nextQuery] && queries[nextQuery] != 0;
+		if (timing)
+			glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+	}
+
+	// finish the frame: upscale the offscreen image into the window framebuffer
+	void end()
+	{
+		if (offscreen)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, outputWidth, outputHeight);
+			glDisable(GL_DEPTH_TEST);
+
+			upscaleShader->use();
+			upscaleShader->setVec2("uvScale", glm::vec2((float)renderWidth / outputWidth, (float)renderHeight / outputHeight));
+			upscaleShader->setVec2("uvMax", glm::vec2((renderWidth - 0.5f) / outputWidth, (renderHeight - 0.5f) / outputHeight));
+			glActiveTexture(GL_TEXTURE0 + textureUnit);
+			glBindTexture(GL_TEXTURE_2D, colorTexture);
+			glBindVertexArray(emptyVAO);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+
+			glEnable(GL_DEPTH_TEST);
+		}
+
+		if (timing)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			queryPending[nextQuery] = true;
+			nextQuery = (nextQuery + 1) % QUERY_COUNT;
+		}
+	}
+
+	// when disabled the scene renders straight into the window at full resolution
+	void setEnabled(bool enable)
+	{
+		enabled = enable;
+		currentScale = enable ? currentScale : maxScale;
+		smoothedMs = 0.0f;
+		framesSinceChange = 0;
+	}
+
+	bool isEnabled() const
+	{
+		return enabled;
+	}
+
+	// fraction of the window resolution the scene is rendered at
+	float scale() const
+	{
+		return currentScale;
+	}
+
+	// GPU times of the earlier frames whose queries finished by this frame's begin(), oldest first;
+	// anywhere from none to QUERY_COUNT, since the results arrive a few frames late
+	const std::vector<float>& collectedGpuTimes() const
+	{
+		return collectedMs;
+	}
+
+private:
+	static const unsigned int QUERY_COUNT = 4;
+	static const int SETTLE_FRAMES = 8;		// frames to measure at a new scale before judging it
+
+	Shader* upscaleShader;
+	unsigned int textureUnit;
+	GpuHandle fbo, colorTexture, depthBuffer, emptyVAO;
+	GpuHandle queries[QUERY_COUNT];
+	bool queryPending[QUERY_COUNT];
+
+	float currentScale;
+	bool enabled;
+	int outputWidth, outputHeight;
+	int renderWidth, renderHeight;
+	bool offscreen;
+	float smoothedMs;
+	std::vector<float> collectedMs;
+	int framesSinceChange;
+	unsigned int nextQuery;
+	bool timing;
+
+	void allocate(int width, int height)
+	{
+		outputWidth = width;
+		outputHeight = height;
+		fbo.reset();
+		colorTexture.reset();
+		depthBuffer.reset();
+		if (width <= 0 || height <= 0)
+			return;
+
+		colorTexture = gpuResources().createTexture("dynamic resolution color");
+		depthBuffer = gpuResources().createRenderbuffer("dynamic resolution depth");
+		if (!colorTexture.track((size_t)width * height * 4) || !depthBuffer.track((size_t)width * height * 4))
+		{
+			colorTexture.reset();
+			depthBuffer.reset();
+			return;
+		}
+
+		// bind on our own unit; the active one may hold a material map
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_2D, colorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+		fbo = gpuResources().createFramebuffer("dynamic resolution target");
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Dynamic resolution framebuffer is not complete, rendering at full resolution" << std::endl;
+			fbo.reset();
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// read every finished query, oldest first, and feed the controller
+	void collectTimings()
+	{
+		for (unsigned int i = 0; i < QUERY_COUNT; i++)
+		{
+			unsigned int index = (nextQuery + i) % QUERY_COUNT;
+			if (!queryPending[index])
+				continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsed);
+			queryPending[index] = false;
+			collectedMs.push_back(elapsed / 1000000.0f);
+			update(elapsed / 1000000.0f);
+		}
+	}
+
+	void update(float frameMs)
+	{
+		const float SCALE_STEP = 0.05f;
+		const float MAX_SCALE_CHANGE = 0.15f;
+
+		smoothedMs = smoothedMs == 0.0f ? frameMs : smoothedMs * 0.9f + frameMs * 0.1f;
+		if (!enabled || ++framesSinceChange < SETTLE_FRAMES)
+			return;
+
+		// leave a dead band so the scale does not hunt around the target
+		if (smoothedMs < targetFrameMs * 1.05f && smoothedMs > targetFrameMs * 0.8f)
+			return;
+
+		// GPU time goes roughly with pixel count, i.e. with the square of the scale
+		float desired = currentScale * std::sqrt(targetFrameMs / smoothedMs);
+		desired = std::min(std::max(desired, currentScale - MAX_SCALE_CHANGE), currentScale + MAX_SCALE_CHANGE);
+		desired = std::min(std::max(desired, minScale), maxScale);
+		desired = std::round(desired / SCALE_STEP) * SCALE_STEP;
+		desired = std::min(std::max(desired, minScale), maxScale);
+
+		if (std::fabs(desired - currentScale) > 0.001f)
+		{
+			currentScale = desired;
+			smoothedMs = 0.0f;
+			framesSinceChange = 0;
+		}
+	}
+};
+#endif
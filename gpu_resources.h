@@ -0,0 +1,304 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <iostream>
+#include <iomanip>
+#include <cstddef>
+
+enum GpuResourceType {
+	GPU_BUFFER,
+	GPU_VERTEX_ARRAY,
+	GPU_TEXTURE,
+	GPU_PROGRAM,
+	GPU_FRAMEBUFFER,
+	GPU_RENDERBUFFER,
+	GPU_QUERY,
+	GPU_RESOURCE_TYPES
+};
+
+// Move-only owner of one GL object. The object is deleted and dropped from the
+// registry when the handle is destroyed or reset.
+class GpuHandle
+{
+public:
+	GpuHandle() : type(GPU_BUFFER), id(0)
+	{
+	}
+
+	GpuHandle(GpuResourceType type, GLuint id) : type(type), id(id)
+	{
+	}
+
+	~GpuHandle()
+	{
+		reset();
+	}
+
+	GpuHandle(const GpuHandle&) = delete;
+	GpuHandle& operator=(const GpuHandle&) = delete;
+
+	GpuHandle(GpuHandle&& other) noexcept : type(other.type), id(other.id)
+	{
+		other.id = 0;
+	}
+
+	GpuHandle& operator=(GpuHandle&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			type = other.type;
+			id = other.id;
+			other.id = 0;
+		}
+		return *this;
+	}
+
+	GLuint get() const
+	{
+		return id;
+	}
+
+	operator GLuint() const
+	{
+		return id;
+	}
+
+	// record the estimated GPU size; returns false (and records nothing) if it would exceed the budget
+	bool track(size_t bytes);
+
+	// delete the GL object now
+	void reset();
+
+private:
+	GpuResourceType type;
+	GLuint id;
+};
+
+// Keeps a record of every live GL object created through it, with an estimated
+// size per object and per category, an optional memory budget and a leak report.
+class GpuResourceRegistry
+{
+public:
+	GpuResourceRegistry() : budget(0), totalBytes(0), peakBytes(0)
+	{
+		for (int i = 0; i < GPU_RESOURCE_TYPES; i++)
+		{
+			categoryBytes[i] = 0;
+			categoryCount[i] = 0;
+		}
+	}
+
+	GpuHandle createBuffer(const std::string& label)
+	{
+		GLuint id;
+		glGenBuffers(1, &id);
+		return add(GPU_BUFFER, id, label);
+	}
+
+	GpuHandle createVertexArray(const std::string& label)
+	{
+		GLuint id;
+		glGenVertexArrays(1, &id);
+		return add(GPU_VERTEX_ARRAY, id, label);
+	}
+
+	GpuHandle createTexture(const std::string& label)
+	{
+		GLuint id;
+		glGenTextures(1, &id);
+		return add(GPU_TEXTURE, id, label);
+	}
+
+	GpuHandle createFramebuffer(const std::string& label)
+	{
+		GLuint id;
+		glGenFramebuffers(1, &id);
+		return add(GPU_FRAMEBUFFER, id, label);
+	}
+
+	GpuHandle createRenderbuffer(const std::string& label)
+	{
+		GLuint id;
+		glGenRenderbuffers(1, &id);
+		return add(GPU_RENDERBUFFER, id, label);
+	}
+
+	GpuHandle createQuery(const std::string& label)
+	{
+		GLuint id;
+		glGenQueries(1, &id);
+		return add(GPU_QUERY, id, label);
+	}
+
+	// take ownership of a program linked elsewhere (e.g. by the Shader class)
+	GpuHandle adoptProgram(GLuint id, const std::string& label)
+	{
+		return add(GPU_PROGRAM, id, label);
+	}
+
+	// 0 means no budget
+	void setBudget(size_t bytes)
+	{
+		budget = bytes;
+	}
+
+	size_t bytesInUse() const
+	{
+		return totalBytes;
+	}
+
+	size_t liveCount() const
+	{
+		return resources.size();
+	}
+
+	bool track(GpuResourceType type, GLuint id, size_t bytes)
+	{
+		std::map<Key, Record>::iterator it = resources.find(Key(type, id));
+		if (it == resources.end())
+			return false;
+
+		size_t newTotal = totalBytes - it->second.bytes + bytes;
+		if (budget != 0 && bytes > it->second.bytes && newTotal > budget)
+		{
+			std::cout << "GPU memory budget exceeded: " << it->second.label << " needs " << bytes
+				<< " bytes, " << (totalBytes < budget ? budget - totalBytes : 0) << " of " << budget << " left" << std::endl;
+			return false;
+		}
+
+		categoryBytes[type] = categoryBytes[type] - it->second.bytes + bytes;
+		totalBytes = newTotal;
+		if (totalBytes > peakBytes)
+			peakBytes = totalBytes;
+		it->second.bytes = bytes;
+		return true;
+	}
+
+	void destroy(GpuResourceType type, GLuint id)
+	{
+		switch (type)
+		{
+		case GPU_BUFFER: glDeleteBuffers(1, &id); break;
+		case GPU_VERTEX_ARRAY: glDeleteVertexArrays(1, &id); break;
+		case GPU_TEXTURE: glDeleteTextures(1, &id); break;
+		case GPU_PROGRAM: glDeleteProgram(id); break;
+		case GPU_FRAMEBUFFER: glDeleteFramebuffers(1, &id); break;
+		case GPU_RENDERBUFFER: glDeleteRenderbuffers(1, &id); break;
+		case GPU_QUERY: glDeleteQueries(1, &id); break;
+		default: break;
+		}
+
+		std::map<Key, Record>::iterator it = resources.find(Key(type, id));
+		if (it == resources.end())
+			return;
+		categoryBytes[type] -= it->second.bytes;
+		categoryCount[type]--;
+		totalBytes -= it->second.bytes;
+		resources.erase(it);
+	}
+
+	// print every live resource with per-category totals
+	void report(std::ostream& out) const
+	{
+		out << "GPU resources: " << resources.size() << " live, " << totalBytes << " bytes (peak " << peakBytes << ")";
+		if (budget != 0)
+			out << ", budget " << budget;
+		out << std::endl;
+
+		for (int i = 0; i < GPU_RESOURCE_TYPES; i++)
+		{
+			if (categoryCount[i] == 0)
+				continue;
+			out << "  " << std::left << std::setw(14) << typeName((GpuResourceType)i) << std::right
+				<< std::setw(5) << categoryCount[i] << std::setw(14) << categoryBytes[i] << " bytes" << std::endl;
+		}
+		for (std::map<Key, Record>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+		{
+			out << "    " << typeName(it->first.first) << " " << it->first.second << " '" << it->second.label << "' "
+				<< it->second.bytes << " bytes" << std::endl;
+		}
+	}
+
+	// call once every handle should be gone; anything still registered leaked
+	bool reportLeaks(std::ostream& out) const
+	{
+		if (resources.empty())
+		{
+			out << "GPU resources: no leaks (peak " << peakBytes << " bytes)" << std::endl;
+			return false;
+		}
+		out << "GPU resources: " << resources.size() << " leaked" << std::endl;
+		report(out);
+		return true;
+	}
+
+	static const char* typeName(GpuResourceType type)
+	{
+		switch (type)
+		{
+		case GPU_BUFFER: return "buffer";
+		case GPU_VERTEX_ARRAY: return "vertex array";
+		case GPU_TEXTURE: return "texture";
+		case GPU_PROGRAM: return "program";
+		case GPU_FRAMEBUFFER: return "framebuffer";
+		case GPU_RENDERBUFFER: return "renderbuffer";
+		case GPU_QUERY: return "query";
+		default: return "unknown";
+		}
+	}
+
+private:
+	typedef std::pair<GpuResourceType, GLuint> Key;
+
+	struct Record
+	{
+		std::string label;
+		size_t bytes;
+	};
+
+	std::map<Key, Record> resources;
+	size_t categoryBytes[GPU_RESOURCE_TYPES];
+	size_t categoryCount[GPU_RESOURCE_TYPES];
+	size_t budget;
+	size_t totalBytes;
+	size_t peakBytes;
+
+	GpuHandle add(GpuResourceType type, GLuint id, const std::string& label)
+	{
+		if (id == 0)
+			return GpuHandle();
+
+		Record record;
+		record.label = label;
+		record.bytes = 0;
+		resources[Key(type, id)] = record;
+		categoryCount[type]++;
+		return GpuHandle(type, id);
+	}
+};
+
+// the one registry shared by the whole program
+inline GpuResourceRegistry& gpuResources()
+{
+	static GpuResourceRegistry registry;
+	return registry;
+}
+
+inline bool GpuHandle::track(size_t bytes)
+{
+	return id != 0 && gpuResources().track(type, id, bytes);
+}
+
+inline void GpuHandle::reset()
+{
+	if (id != 0)
+		gpuResources().destroy(type, id);
+	id = 0;
+}
+#endif
@@ -0,0 +1,317 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "gpu_resources.h"
+
+#include <vector>
+#include <cstddef>
+
+// GL 4.0 / ARB_draw_indirect; a 3.3 core loader does not define it
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// layout of one command in the GL_DRAW_INDIRECT_BUFFER, as defined by the GL spec
+struct DrawArraysIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
+};
+
+// per-draw data, read by the vertex shader through instanced attributes 3-6.
+// Each command draws a single instance starting at baseInstance = its draw index,
+// so the attribute fetch picks out the matching transform.
+struct DrawInstance
+{
+	glm::mat4 model;
+};
+
+// Compiles a static scene into one vertex buffer plus an indirect command buffer
+// and submits it with a single glMultiDrawArraysIndirect. Vertices use the same
+// position/normal/texcoord layout (8 floats) as the rest of the scene; the
+// material index goes per vertex in a buffer of its own (attribute 7), so one
+// draw may mix materials.
+// Transforms and visibility may change per frame through setDraw() (safe to call
+// from worker threads for different draws) followed by upload() on the GL thread.
+// Multi-draw indirect (GL 4.3 / ARB_multi_draw_indirect) and base instance
+// (GL 4.2 / ARB_base_instance) are looked up at runtime through GLFW, so they
+// work with a plain 3.3 core loader; where either is missing draw() falls back
+// to a loop.
+class IndirectScene
+{
+public:
+	IndirectScene() : multiDraw(false), baseInstance(false), multiDrawArraysIndirect(NULL), drawArraysInstancedBaseInstance(NULL)
+	{
+	}
+
+	// append a mesh with a material index per vertex; returns its draw index
+	unsigned int addMesh(const float* data, size_t bytes, const GLint* materials, const glm::mat4& model)
+	{
+		size_t floatCount = bytes / sizeof(float);
+
+		DrawArraysIndirectCommand command;
+		command.count = (GLuint)(floatCount / FLOATS_PER_VERTEX);
+		command.instanceCount = 1;
+		command.first = (GLuint)(vertices.size() / FLOATS_PER_VERTEX);
+		command.baseInstance = (GLuint)commands.size();
+		commands.push_back(command);
+
+		DrawInstance instance;
+		instance.model = model;
+		instances.push_back(instance);
+		changed.push_back(0);
+
+		boundsMin.push_back(glm::vec3(0.0f));
+		boundsMax.push_back(glm::vec3(0.0f));
+		computeBounds(command.baseInstance, data, floatCount);
+
+		vertices.insert(vertices.end(), data, data + floatCount);
+		vertexMaterials.insert(vertexMaterials.end(), materials, materials + command.count);
+		return command.baseInstance;
+	}
+
+	// upload everything to the GPU; call once after all meshes are added.
+	// Returns false if the buffers do not fit in the GPU memory budget.
+	bool build()
+	{
+		detectSupport();
+
+		VAO = gpuResources().createVertexArray("static scene VAO");
+		vertexVBO = gpuResources().createBuffer("static scene vertices");
+		materialVBO = gpuResources().createBuffer("static scene vertex materials");
+		instanceVBO = gpuResources().createBuffer("static scene per-draw data");
+		// the command buffer is only read by glMultiDrawArraysIndirect; the loop reads commands from memory
+		if (multiDraw)
+			indirectBuffer = gpuResources().createBuffer("static scene indirect commands");
+		if (!vertexVBO.track(vertices.size() * sizeof(float)) ||
+			!materialVBO.track(vertexMaterials.size() * sizeof(GLint)) ||
+			!instanceVBO.track(instances.size() * sizeof(DrawInstance)) ||
+			(multiDraw && !indirectBuffer.track(commands.size() * sizeof(DrawArraysIndirectCommand))))
+		{
+			release();
+			return false;
+		}
+
+		glBindVertexArray(VAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(6 * sizeof(float)));
+		glEnableVertexAttribArray(2);
+
+		glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+		glBufferData(GL_ARRAY_BUFFER, vertexMaterials.size() * sizeof(GLint), vertexMaterials.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(7, 1, GL_INT, sizeof(GLint), (void*)0);
+		glEnableVertexAttribArray(7);
+
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(DrawInstance), instances.data(), GL_DYNAMIC_DRAW);
+		setInstanceAttributes(0);
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			glEnableVertexAttribArray(3 + i);
+			glVertexAttribDivisor(3 + i, 1);
+		}
+
+		// the indirect buffer binding is not part of VAO state, it is bound again in draw()
+		if (multiDraw)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+
+		glBindVertexArray(0);
+
+		// the GPU copies are all we need from here on
+		vertices.clear();
+		vertices.shrink_to_fit();
+		vertexMaterials.clear();
+		vertexMaterials.shrink_to_fit();
+		return true;
+	}
+
+	// replace the vertices of a built mesh with as many new ones, e.g. re-baked static geometry
+	void updateMesh(unsigned int index, const float* data, size_t bytes)
+	{
+		const DrawArraysIndirectCommand& command = commands[index];
+		if (VAO == 0 || bytes != command.count * FLOATS_PER_VERTEX * sizeof(float))
+			return;
+		computeBounds(index, data, bytes / sizeof(float));
+		glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, command.first * FLOATS_PER_VERTEX * sizeof(float), bytes, data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// replace one draw's transform and hide (culled) or show it; touches no GL state,
+	// and leaves the draw alone when neither changed
+	void setDraw(unsigned int index, const glm::mat4& model, bool visible)
+	{
+		GLuint instanceCount = visible ? 1 : 0;
+		if (instances[index].model == model && commands[index].instanceCount == instanceCount)
+			return;
+		instances[index].model = model;
+		commands[index].instanceCount = instanceCount;
+		changed[index] = 1;
+	}
+
+	// send the per-draw data changed by setDraw() to the GPU; nothing is sent if no draw changed
+	void upload()
+	{
+		bool any = false;
+		for (size_t i = 0; i < changed.size(); i++)
+		{
+			any = any || changed[i] != 0;
+			changed[i] = 0;
+		}
+		if (VAO == 0 || !any)
+			return;
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(DrawInstance), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (multiDraw)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data());
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+	}
+
+	// submit every draw; one GL call when multi-draw indirect is available
+	void draw()
+	{
+		if (VAO == 0)
+			return;
+		glBindVertexArray(VAO);
+
+		if (multiDraw)
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			multiDrawArraysIndirect(GL_TRIANGLES, (void*)0, (GLsizei)commands.size(), 0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			return;
+		}
+
+		for (unsigned int i = 0; i < commands.size(); i++)
+		{
+			const DrawArraysIndirectCommand& command = commands[i];
+			if (command.instanceCount == 0)
+				continue;
+			if (baseInstance)
+			{
+				drawArraysInstancedBaseInstance(GL_TRIANGLES, command.first, command.count, command.instanceCount, command.baseInstance);
+				continue;
+			}
+			// no base instance either: point the per-draw attributes at this draw's record
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			setInstanceAttributes(command.baseInstance * sizeof(DrawInstance));
+			glDrawArraysInstanced(GL_TRIANGLES, command.first, command.count, command.instanceCount);
+		}
+	}
+
+	// de-allocate the GPU buffers
+	void release()
+	{
+		VAO.reset();
+		vertexVBO.reset();
+		materialVBO.reset();
+		instanceVBO.reset();
+		indirectBuffer.reset();
+	}
+
+	unsigned int drawCount() const
+	{
+		return (unsigned int)commands.size();
+	}
+
+	// GL draw calls one draw() makes
+	unsigned int submissionCount() const
+	{
+		if (multiDraw)
+			return 1;
+		unsigned int visible = 0;
+		for (size_t i = 0; i < commands.size(); i++)
+			visible += commands[i].instanceCount > 0 ? 1 : 0;
+		return visible;
+	}
+
+	// model-space bounding box of one draw's vertices
+	void bounds(unsigned int index, glm::vec3& low, glm::vec3& high) const
+	{
+		low = boundsMin[index];
+		high = boundsMax[index];
+	}
+
+	bool usesMultiDraw() const
+	{
+		return multiDraw;
+	}
+
+private:
+	static const unsigned int FLOATS_PER_VERTEX = 8;
+
+	GpuHandle VAO, vertexVBO, materialVBO, instanceVBO, indirectBuffer;
+	std::vector<float> vertices;
+	std::vector<GLint> vertexMaterials;
+	std::vector<DrawArraysIndirectCommand> commands;
+	std::vector<DrawInstance> instances;
+	std::vector<unsigned char> changed;		// per draw, set by setDraw(); not vector<bool>, draws are written in parallel
+	std::vector<glm::vec3> boundsMin, boundsMax;
+	bool multiDraw;
+	bool baseInstance;
+
+	// entry points newer than the 3.3 core loader, fetched by detectSupport()
+	typedef void (APIENTRYP MultiDrawArraysIndirectProc)(GLenum mode, const void* indirect, GLsizei drawcount, GLsizei stride);
+	typedef void (APIENTRYP DrawArraysInstancedBaseInstanceProc)(GLenum mode, GLint first, GLsizei count, GLsizei instancecount, GLuint baseinstance);
+	MultiDrawArraysIndirectProc multiDrawArraysIndirect;
+	DrawArraysInstancedBaseInstanceProc drawArraysInstancedBaseInstance;
+
+	// mat4 takes four vec4 attribute slots (3-6)
+	void setInstanceAttributes(size_t offset)
+	{
+		for (unsigned int i = 0; i < 4; i++)
+			glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(DrawInstance), (void*)(offset + i * sizeof(glm::vec4)));
+	}
+
+	void computeBounds(unsigned int index, const float* data, size_t floatCount)
+	{
+		glm::vec3 low(data[0], data[1], data[2]), high = low;
+		for (size_t i = 0; i + 2 < floatCount; i += FLOATS_PER_VERTEX)
+		{
+			glm::vec3 position(data[i], data[i + 1], data[i + 2]);
+			low = glm::min(low, position);
+			high = glm::max(high, position);
+		}
+		boundsMin[index] = low;
+		boundsMax[index] = high;
+	}
+
+	// needs the context current; ARB_multi_draw_indirect also needs the indirect buffer target of ARB_draw_indirect
+	void detectSupport()
+	{
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		int version = major * 10 + minor;
+
+		if (version >= 42 || glfwExtensionSupported("GL_ARB_base_instance"))
+			drawArraysInstancedBaseInstance = (DrawArraysInstancedBaseInstanceProc)glfwGetProcAddress("glDrawArraysInstancedBaseInstance");
+		if (version >= 43 || (glfwExtensionSupported("GL_ARB_multi_draw_indirect") && (version >= 40 || glfwExtensionSupported("GL_ARB_draw_indirect"))))
+			multiDrawArraysIndirect = (MultiDrawArraysIndirectProc)glfwGetProcAddress("glMultiDrawArraysIndirect");
+
+		baseInstance = drawArraysInstancedBaseInstance != NULL;
+		// without base instance every command would read draw 0's transform
+		multiDraw = multiDrawArraysIndirect != NULL && baseInstance;
+	}
+};
+#endif
@@ -0,0 +1,315 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <new>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+// One node of a TaskGraph. It becomes runnable once every task it depends on has finished.
+struct Task
+{
+	std::function<void()> work;
+	std::vector<Task*> successors;
+	int dependencies;
+	std::atomic<int> pending;
+	std::atomic<int>* remaining;			// the owning graph's count of unfinished tasks
+};
+
+// Work-stealing scheduler. Every worker owns a deque: it pushes and pops work
+// at the back (most recently spawned first, which keeps caches warm) while idle
+// workers steal from the front of someone else's. The thread that runs a graph
+// has a deque of its own and works through tasks while it waits.
+class JobSystem
+{
+public:
+	struct Stats
+	{
+		unsigned long long executed;
+		unsigned long long steals;
+		unsigned long long stealAttempts;
+		double idleMs;						// worker time without a task while a graph was running, summed over workers
+	};
+
+	// workerCount threads besides the caller; by default one per core after the caller's
+	explicit JobSystem(unsigned int workerCount = defaultWorkerCount())
+		: workers(workerCount), queues(new Queue[workerCount + 1]), queued(0), sleeping(0), stopping(false)
+	{
+		// new[] only guarantees alignof(max_align_t) before C++17, so line the counters up by hand
+		counterStorage.reset(new char[(workers + 1) * sizeof(Counters) + CACHE_LINE]);
+		void* first = counterStorage.get();
+		size_t space = (workers + 1) * sizeof(Counters) + CACHE_LINE;
+		counters = (Counters*)std::align(CACHE_LINE, (workers + 1) * sizeof(Counters), first, space);
+		for (unsigned int i = 0; i <= workers; i++)
+			new (&counters[i]) Counters();
+		resetStats();
+		for (unsigned int i = 0; i < workers; i++)
+			threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+	static unsigned int defaultWorkerCount()
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		return cores > 1 ? cores - 1 : 0;
+	}
+
+	// threads that execute tasks, including the caller of TaskGraph::run
+	unsigned int threadCount() const
+	{
+		return workers + 1;
+	}
+
+	// queue index of the thread that calls TaskGraph::run
+	unsigned int callerSlot() const
+	{
+		return workers;
+	}
+
+	void push(Task* task, unsigned int slot)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queues[slot].mutex);
+			queues[slot].tasks.push_back(task);
+		}
+		queued.fetch_add(1);
+		if (sleeping.load() > 0)
+		{
+			// taking the lock orders this with a worker between its check and its wait
+			{
+				std::lock_guard<std::mutex> lock(wakeMutex);
+			}
+			wake.notify_one();
+		}
+	}
+
+	// run one task from the slot's own deque or stolen from another; false if there was none
+	bool runOne(unsigned int slot)
+	{
+		Task* task = popBack(slot);
+		if (!task)
+			task = steal(slot);
+		if (!task)
+			return false;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		task->work();
+		counters[slot].busyNs.fetch_add((std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+		counters[slot].executed.fetch_add(1, std::memory_order_relaxed);
+		for (size_t i = 0; i < task->successors.size(); i++)
+		{
+			if (task->successors[i]->pending.fetch_sub(1) == 1)
+				push(task->successors[i], slot);
+		}
+		task->remaining->fetch_sub(1);
+		return true;
+	}
+
+	// called by TaskGraph::run with how long the graph took, from its start until the last task finished
+	void graphRan(std::chrono::nanoseconds duration)
+	{
+		graphNs.fetch_add(duration.count(), std::memory_order_relaxed);
+	}
+
+	Stats stats() const
+	{
+		Stats total = { 0, 0, 0, 0.0 };
+		double busyNs = 0.0;
+		for (unsigned int i = 0; i <= workers; i++)
+		{
+			total.executed += counters[i].executed.load();
+			total.steals += counters[i].steals.load();
+			total.stealAttempts += counters[i].stealAttempts.load();
+			if (i < workers)
+				busyNs += (double)counters[i].busyNs.load();
+		}
+		// tasks only exist while a graph runs, so whatever a worker did not spend in one is idle
+		// time within the graph; the time between frames is not counted
+		total.idleMs = std::max((double)graphNs.load() * workers - busyNs, 0.0) / 1000000.0;
+		return total;
+	}
+
+	void resetStats()
+	{
+		for (unsigned int i = 0; i <= workers; i++)
+		{
+			counters[i].executed = 0;
+			counters[i].steals = 0;
+			counters[i].stealAttempts = 0;
+			counters[i].busyNs = 0;
+		}
+		graphNs = 0;
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task*> tasks;
+	};
+
+	static const size_t CACHE_LINE = 64;
+
+	// one cache line per thread so the counters do not false-share
+	struct alignas(CACHE_LINE) Counters
+	{
+		std::atomic<unsigned long long> executed;
+		std::atomic<unsigned long long> steals;
+		std::atomic<unsigned long long> stealAttempts;
+		std::atomic<unsigned long long> busyNs;		// time spent inside tasks
+	};
+
+	unsigned int workers;
+	std::unique_ptr<Queue[]> queues;
+	std::unique_ptr<char[]> counterStorage;
+	Counters* counters;						// workers + 1 of them, cache line aligned, in counterStorage
+	std::atomic<unsigned long long> graphNs;
+	std::vector<std::thread> threads;
+	std::atomic<int> queued;
+	std::atomic<int> sleeping;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	Task* popBack(unsigned int slot)
+	{
+		std::lock_guard<std::mutex> lock(queues[slot].mutex);
+		if (queues[slot].tasks.empty())
+			return NULL;
+		Task* task = queues[slot].tasks.back();
+		queues[slot].tasks.pop_back();
+		queued.fetch_sub(1);
+		return task;
+	}
+
+	// take the oldest task of the first other deque that has one
+	Task* steal(unsigned int slot)
+	{
+		if (queued.load() == 0)
+			return NULL;
+
+		unsigned int count = workers + 1;
+		for (unsigned int i = 1; i < count; i++)
+		{
+			unsigned int victim = (slot + i) % count;
+			counters[slot].stealAttempts.fetch_add(1, std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock(queues[victim].mutex);
+			if (queues[victim].tasks.empty())
+				continue;
+			Task* task = queues[victim].tasks.front();
+			queues[victim].tasks.pop_front();
+			queued.fetch_sub(1);
+			counters[slot].steals.fetch_add(1, std::memory_order_relaxed);
+			return task;
+		}
+		return NULL;
+	}
+
+	void workerLoop(unsigned int slot)
+	{
+		for (;;)
+		{
+			if (runOne(slot))
+				continue;
+
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			sleeping.fetch_add(1);
+			wake.wait(lock, [this] { return queued.load() > 0 || stopping; });
+			sleeping.fetch_sub(1);
+			if (stopping)
+				return;
+		}
+	}
+};
+
+// Frame-graph style set of tasks with dependencies. Build it once, then run()
+// it as often as needed; each run executes every task after its dependencies.
+class TaskGraph
+{
+public:
+	typedef unsigned int TaskId;
+
+	TaskGraph() : remaining(0)
+	{
+	}
+
+	TaskId add(const std::function<void()>& work, const std::vector<TaskId>& dependencies = std::vector<TaskId>())
+	{
+		std::unique_ptr<Task> task(new Task());
+		task->work = work;
+		task->dependencies = (int)dependencies.size();
+		task->remaining = &remaining;
+		for (size_t i = 0; i < dependencies.size(); i++)
+			tasks[dependencies[i]]->successors.push_back(task.get());
+		tasks.push_back(std::move(task));
+		return (TaskId)(tasks.size() - 1);
+	}
+
+	// split [0, count) into chunks of at most grain items; returns a task that finishes after all of them
+	TaskId addParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& work,
+		const std::vector<TaskId>& dependencies = std::vector<TaskId>())
+	{
+		std::vector<TaskId> chunks;
+		grain = std::max(grain, (size_t)1);
+		for (size_t begin = 0; begin < count; begin += grain)
+		{
+			size_t end = std::min(begin + grain, count);
+			chunks.push_back(add([work, begin, end] { work(begin, end); }, dependencies));
+		}
+		if (chunks.empty())
+			return add([] {}, dependencies);
+		return add([] {}, chunks);
+	}
+
+	// execute every task; the calling thread helps until the whole graph is done
+	void run(JobSystem& jobs)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		remaining = (int)tasks.size();
+		for (size_t i = 0; i < tasks.size(); i++)
+			tasks[i]->pending = tasks[i]->dependencies;
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			if (tasks[i]->dependencies == 0)
+				jobs.push(tasks[i].get(), jobs.callerSlot());
+		}
+		while (remaining.load() > 0)
+		{
+			if (!jobs.runOne(jobs.callerSlot()))
+				std::this_thread::yield();
+		}
+		jobs.graphRan(std::chrono::steady_clock::now() - start);
+	}
+
+	void clear()
+	{
+		tasks.clear();
+	}
+
+	bool empty() const
+	{
+		return tasks.empty();
+	}
+
+private:
+	std::vector<std::unique_ptr<Task> > tasks;
+	std::atomic<int> remaining;
+};
+#endif
@@ -0,0 +1,306 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+
+// Streaming RGB PNG encoder. Rows are handed over top to bottom in any number
+// of writeRows() calls and compressed as they arrive, so only the deflate
+// window (32 KB) and the previous row are kept between calls; the image as a
+// whole is never held in memory.
+//
+// Compression is a small deflate of its own: greedy LZ77 over a single-entry
+// hash table, coded with the fixed Huffman tables, with the PNG "Up" filter on
+// every row. That is far from zlib's ratio but costs little CPU, and a render
+// with large flat areas still shrinks well.
+class PngWriter
+{
+public:
+	PngWriter() : file(NULL), width(0), height(0), rowsWritten(0), bitBuffer(0), bitCount(0), adlerA(1), adlerB(0), historyStart(0)
+	{
+	}
+
+	~PngWriter()
+	{
+		if (file)
+			fclose(file);
+	}
+
+	bool open(const char* path, int imageWidth, int imageHeight)
+	{
+		file = fopen(path, "wb");
+		if (!file)
+			return false;
+
+		width = imageWidth;
+		height = imageHeight;
+		rowsWritten = 0;
+		previousRow.assign((size_t)width * 3, 0);
+		filteredRow.resize((size_t)width * 3 + 1);
+		for (int i = 0; i < HASH_SIZE; i++)
+			hashHead[i] = -1;
+
+		static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		fwrite(signature, 1, 8, file);
+
+		unsigned char header[13];
+		putBigEndian(header, width);
+		putBigEndian(header + 4, height);
+		header[8] = 8;		// bit depth
+		header[9] = 2;		// color type: RGB
+		header[10] = 0;		// deflate
+		header[11] = 0;		// adaptive filtering
+		header[12] = 0;		// no interlace
+		writeChunk("IHDR", header, 13);
+
+		// zlib header: deflate with a 32 KB window, no preset dictionary
+		out.push_back(0x78);
+		out.push_back(0x01);
+		return true;
+	}
+
+	// append rows of tightly packed RGB pixels, top row first
+	void writeRows(const unsigned char* rgb, int rows)
+	{
+		size_t rowBytes = (size_t)width * 3;
+		for (int r = 0; r < rows && rowsWritten < height; r++, rowsWritten++)
+		{
+			const unsigned char* row = rgb + r * rowBytes;
+			filteredRow[0] = 2;		// Up filter
+			for (size_t i = 0; i < rowBytes; i++)
+				filteredRow[i + 1] = (unsigned char)(row[i] - previousRow[i]);
+			memcpy(&previousRow[0], row, rowBytes);
+			deflate(&filteredRow[0], filteredRow.size());
+		}
+		flushOutput(false);
+	}
+
+	// finish the stream and close the file; false if rows are missing or writing failed
+	bool close()
+	{
+		if (!file)
+			return false;
+
+		// empty final fixed-Huffman block, then pad to a byte
+		writeBits(1, 1);
+		writeBits(1, 2);
+		writeCode(256);
+		if (bitCount > 0)
+			writeBits(0, 8 - bitCount);
+
+		out.push_back((unsigned char)(adlerB >> 8));
+		out.push_back((unsigned char)adlerB);
+		out.push_back((unsigned char)(adlerA >> 8));
+		out.push_back((unsigned char)adlerA);
+		flushOutput(true);
+		writeChunk("IEND", NULL, 0);
+
+		bool ok = ferror(file) == 0 && rowsWritten == height;
+		ok = fclose(file) == 0 && ok;
+		file = NULL;
+		return ok;
+	}
+
+private:
+	static const int WINDOW_SIZE = 32768;
+	static const int HASH_BITS = 15;
+	static const int HASH_SIZE = 1 << HASH_BITS;
+	static const int MIN_MATCH = 3;
+	static const int MAX_MATCH = 258;
+	static const size_t IDAT_SIZE = 1 << 16;
+
+	FILE* file;
+	int width, height, rowsWritten;
+	std::vector<unsigned char> previousRow, filteredRow;
+
+	std::vector<unsigned char> out;			// compressed bytes not yet written as an IDAT chunk
+	unsigned int bitBuffer;
+	int bitCount;
+	unsigned int adlerA, adlerB;
+
+	// uncompressed history: the last WINDOW_SIZE bytes before the data being deflated
+	std::vector<unsigned char> history;
+	long long historyStart;					// stream position of history[0]
+	long long hashHead[HASH_SIZE];			// stream position of the last string with each hash
+
+	static void putBigEndian(unsigned char* p, unsigned int v)
+	{
+		p[0] = (unsigned char)(v >> 24);
+		p[1] = (unsigned char)(v >> 16);
+		p[2] = (unsigned char)(v >> 8);
+		p[3] = (unsigned char)v;
+	}
+
+	static unsigned int crc32(unsigned int crc, const unsigned char* data, size_t length)
+	{
+		static unsigned int table[256];
+		static bool tableReady = false;
+		if (!tableReady)
+		{
+			for (unsigned int n = 0; n < 256; n++)
+			{
+				unsigned int c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+			tableReady = true;
+		}
+		for (size_t i = 0; i < length; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return crc;
+	}
+
+	void writeChunk(const char* type, const unsigned char* data, size_t length)
+	{
+		unsigned char header[8];
+		putBigEndian(header, (unsigned int)length);
+		memcpy(header + 4, type, 4);
+		unsigned int crc = crc32(0xFFFFFFFFu, header + 4, 4);
+		if (length > 0)
+			crc = crc32(crc, data, length);
+
+		unsigned char footer[4];
+		putBigEndian(footer, crc ^ 0xFFFFFFFFu);
+		fwrite(header, 1, 8, file);
+		if (length > 0)
+			fwrite(data, 1, length, file);
+		fwrite(footer, 1, 4, file);
+	}
+
+	void flushOutput(bool all)
+	{
+		while (out.size() >= IDAT_SIZE || (all && !out.empty()))
+		{
+			size_t length = out.size() < IDAT_SIZE ? out.size() : IDAT_SIZE;
+			writeChunk("IDAT", &out[0], length);
+			out.erase(out.begin(), out.begin() + length);
+		}
+	}
+
+	// deflate bit order: values go in least significant bit first
+	void writeBits(unsigned int value, int count)
+	{
+		bitBuffer |= value << bitCount;
+		bitCount += count;
+		while (bitCount >= 8)
+		{
+			out.push_back((unsigned char)bitBuffer);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	// Huffman codes go in most significant bit first
+	void writeReversed(unsigned int code, int length)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		writeBits(reversed, length);
+	}
+
+	// fixed literal/length code (RFC 1951, 3.2.6)
+	void writeCode(int symbol)
+	{
+		if (symbol < 144)
+			writeReversed(0x30 + symbol, 8);
+		else if (symbol < 256)
+			writeReversed(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			writeReversed(symbol - 256, 7);
+		else
+			writeReversed(0xC0 + symbol - 280, 8);
+	}
+
+	void writeMatch(int length, int distance)
+	{
+		static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		int l = 28;
+		while (lengthBase[l] > length)
+			l--;
+		writeCode(257 + l);
+		writeBits(length - lengthBase[l], lengthExtra[l]);
+
+		int d = 29;
+		while (distanceBase[d] > distance)
+			d--;
+		writeReversed(d, 5);
+		writeBits(distance - distanceBase[d], distanceExtra[d]);
+	}
+
+	static unsigned int hash(const unsigned char* p)
+	{
+		return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
+	}
+
+	// compress one buffer as a non-final fixed-Huffman block; matches may reach back into earlier calls
+	void deflate(const unsigned char* data, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			adlerA = (adlerA + data[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+
+		// work on history + data so back references are plain offsets
+		size_t start = history.size();
+		history.insert(history.end(), data, data + length);
+		const unsigned char* buffer = &history[0];
+		size_t end = history.size();
+
+		writeBits(0, 1);		// BFINAL
+		writeBits(1, 2);		// BTYPE: fixed Huffman
+
+		size_t i = start;
+		while (i < end)
+		{
+			int bestLength = 0;
+			long long position = historyStart + (long long)i;
+			if (i + MIN_MATCH <= end)
+			{
+				unsigned int h = hash(buffer + i);
+				long long candidate = hashHead[h];
+				hashHead[h] = position;
+
+				if (candidate >= historyStart && position - candidate <= WINDOW_SIZE)
+				{
+					size_t c = (size_t)(candidate - historyStart);
+					size_t limit = end - i < (size_t)MAX_MATCH ? end - i : (size_t)MAX_MATCH;
+					size_t n = 0;
+					while (n < limit && buffer[c + n] == buffer[i + n])
+						n++;
+					bestLength = (int)n;
+				}
+
+				if (bestLength >= MIN_MATCH)
+				{
+					writeMatch(bestLength, (int)(position - candidate));
+					// index the strings inside the match too, so later data can refer to them
+					for (size_t k = i + 1; k < i + bestLength && k + MIN_MATCH <= end; k++)
+						hashHead[hash(buffer + k)] = historyStart + (long long)k;
+					i += bestLength;
+					continue;
+				}
+			}
+			writeCode(buffer[i]);
+			i++;
+		}
+		writeCode(256);
+
+		// keep only the window for the next call
+		if (history.size() > (size_t)WINDOW_SIZE)
+		{
+			size_t drop = history.size() - WINDOW_SIZE;
+			history.erase(history.begin(), history.begin() + drop);
+			historyStart += drop;
+		}
+	}
+};
+#endif
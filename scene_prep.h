@@ -0,0 +1,213 @@
+#ifndef SCENE_PREP_H
+#define SCENE_PREP_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "job_system.h"
+#include "indirect_draw.h"
+
+#include <vector>
+#include <cmath>
+
+// where one scene object sits; turned into its model matrix every frame
+struct SceneTransform
+{
+	glm::vec3 position;
+	glm::vec3 scale;
+	float angle;			// degrees about axis
+	glm::vec3 axis;
+
+	SceneTransform(const glm::vec3& position = glm::vec3(0.0f), const glm::vec3& scale = glm::vec3(1.0f),
+		float angle = 0.0f, const glm::vec3& axis = glm::vec3(0.0f, 1.0f, 0.0f))
+		: position(position), scale(scale), angle(angle), axis(axis)
+	{
+	}
+
+	// translate, scale, then rotate, the order the scene has always used
+	glm::mat4 matrix() const
+	{
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, position);
+		model = glm::scale(model, scale);
+		model = glm::rotate(model, glm::radians(angle), axis);
+		return model;
+	}
+};
+
+// Per-frame CPU preparation of the scene, run as a frame graph on the job system:
+//
+//   transforms -> visibility -> draw lists
+//
+// Each stage is a parallel-for over the objects. Transforms build the model
+// matrices, visibility tests world-space bounds against the view frustum, and
+// the draw-list stage writes the indirect scene's per-draw data with culled
+// draws set to zero instances. No stage touches GL; the GL thread only uploads
+// and submits what prepare() leaves behind.
+class ScenePrep
+{
+public:
+	// objects per task; small scenes end up as a single task per stage
+	size_t grain;
+
+	ScenePrep(size_t grain = 256) : grain(grain), graphObjects(0)
+	{
+	}
+
+	// a draw whose vertices are already in world space (a static batch): it keeps an identity
+	// transform that is never rebuilt and only takes part in culling
+	unsigned int addStatic(IndirectScene& scene, unsigned int drawIndex)
+	{
+		Object object;
+		scene.bounds(drawIndex, object.boundsMin, object.boundsMax);
+		object.scene = &scene;
+		object.drawIndex = drawIndex;
+		object.isStatic = true;
+		return addObject(object);
+	}
+
+	// an object drawn on its own, with model-space bounds
+	unsigned int add(const SceneTransform& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		Object object;
+		object.transform = transform;
+		object.boundsMin = boundsMin;
+		object.boundsMax = boundsMax;
+		object.scene = NULL;
+		object.drawIndex = 0;
+		object.isStatic = false;
+		return addObject(object);
+	}
+
+	// replace an object's model-space bounds, e.g. after its mesh was rebuilt
+	void setBounds(unsigned int index, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		objects[index].boundsMin = boundsMin;
+		objects[index].boundsMax = boundsMax;
+	}
+
+	// run the frame graph for one view; the calling thread helps and returns when it is done
+	void prepare(JobSystem& jobs, const glm::mat4& viewProjection)
+	{
+		if (graphObjects != objects.size())
+			buildGraph();
+		extractFrustum(viewProjection);
+		graph.run(jobs);
+	}
+
+	const glm::mat4& model(unsigned int index) const
+	{
+		return models[index];
+	}
+
+	bool isVisible(unsigned int index) const
+	{
+		return visible[index] != 0;
+	}
+
+	size_t size() const
+	{
+		return objects.size();
+	}
+
+private:
+	struct Object
+	{
+		SceneTransform transform;
+		glm::vec3 boundsMin, boundsMax;		// model space
+		IndirectScene* scene;				// NULL for objects drawn on their own
+		unsigned int drawIndex;
+		bool isStatic;						// model stays the identity, skipped by the transform stage
+	};
+
+	std::vector<Object> objects;
+	std::vector<glm::mat4> models;
+	std::vector<unsigned char> visible;		// not vector<bool>: tasks write neighbouring entries at once
+	float planes[6][4];						// frustum planes, a*x + b*y + c*z + d >= 0 inside
+	TaskGraph graph;
+	size_t graphObjects;
+
+	unsigned int addObject(const Object& object)
+	{
+		objects.push_back(object);
+		models.push_back(object.transform.matrix());
+		visible.push_back(1);
+		return (unsigned int)(objects.size() - 1);
+	}
+
+	void buildGraph()
+	{
+		graph.clear();
+		graphObjects = objects.size();
+
+		TaskGraph::TaskId transforms = graph.addParallelFor(objects.size(), grain, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (!objects[i].isStatic)
+					models[i] = objects[i].transform.matrix();
+			}
+		});
+
+		TaskGraph::TaskId visibility = graph.addParallelFor(objects.size(), grain, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				visible[i] = inFrustum(objects[i], models[i]) ? 1 : 0;
+		}, std::vector<TaskGraph::TaskId>(1, transforms));
+
+		graph.addParallelFor(objects.size(), grain, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (objects[i].scene)
+					objects[i].scene->setDraw(objects[i].drawIndex, models[i], visible[i] != 0);
+			}
+		}, std::vector<TaskGraph::TaskId>(1, visibility));
+	}
+
+	// Gribb-Hartmann: each plane is the last row of the matrix plus or minus one of the others
+	void extractFrustum(const glm::mat4& m)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			int row = p / 2;
+			float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+			for (int c = 0; c < 4; c++)
+				planes[p][c] = m[c][3] + sign * m[c][row];
+		}
+	}
+
+	// transform the box centre and project its extents onto the world axes, then test it against each plane
+	bool inFrustum(const Object& object, const glm::mat4& model) const
+	{
+		glm::vec3 centre = (object.boundsMin + object.boundsMax) * 0.5f;
+		glm::vec3 extent = (object.boundsMax - object.boundsMin) * 0.5f;
+
+		float worldCentre[3], worldExtent[3];
+		for (int r = 0; r < 3; r++)
+		{
+			worldCentre[r] = model[3][r];
+			worldExtent[r] = 0.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				worldCentre[r] += model[c][r] * centre[c];
+				worldExtent[r] += std::fabs(model[c][r]) * extent[c];
+			}
+		}
+
+		for (int p = 0; p < 6; p++)
+		{
+			float distance = planes[p][3];
+			float radius = 0.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				distance += planes[p][c] * worldCentre[c];
+				radius += std::fabs(planes[p][c]) * worldExtent[c];
+			}
+			if (distance + radius < 0.0f)
+				return false;
+		}
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per-draw transform, advanced once per instance (each indirect command draws one instance)
+layout (location = 3) in mat4 aModel;
+// material index per vertex, so a static batch can mix materials
+layout (location = 7) in int aMaterial;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out int MaterialIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(aModel))) * aNormal;
+    TexCoords = aTexCoords;
+    MaterialIndex = aMaterial;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+uniform vec2 uvScale;   // size of the rendered region relative to the whole texture
+uniform vec2 uvMax;     // last texel centre of that region, so bilinear taps stay inside it
+
+void main()
+{
+    FragColor = vec4(texture(scene, min(TexCoords * uvScale, uvMax)).rgb, 1.0);
+}
@@ -0,0 +1,189 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "indirect_draw.h"
+#include "scene_prep.h"
+
+#include <vector>
+#include <cstddef>
+#include <iostream>
+
+// Static batching for set dressing that never moves on its own. Objects that
+// share a transform (parts of one prop, like the grater body, its handle and
+// the mat under it) are merged into one batch whatever their materials: each
+// object's world transform is baked into its vertices (positions by the model
+// matrix, normals by the normal matrix) and the material index travels with
+// every vertex. A batch is a single indirect draw with an identity transform,
+// culled as a whole by its world-space bounds, and costs no per-frame
+// transform work or upload.
+//
+// All objects are added before the first build(), which fixes the batches.
+// edit() marks only the edited object's batch dirty, and the next build()
+// re-bakes just the dirty batches into their existing buffer ranges.
+class StaticBatcher
+{
+public:
+	static const unsigned int NO_OBJECT = 0xFFFFFFFF;
+
+	StaticBatcher() : built(false)
+	{
+	}
+
+	// register a static object given as interleaved position/normal/texcoord vertices;
+	// returns its index, or NO_OBJECT once the batches are built
+	unsigned int add(const float* data, size_t bytes, const SceneTransform& transform, int material)
+	{
+		if (built)
+		{
+			std::cout << "Static objects must be added before the first build" << std::endl;
+			return NO_OBJECT;
+		}
+
+		Object object;
+		object.vertices.assign(data, data + bytes / sizeof(float));
+		object.transform = transform;
+		object.material = material;
+		object.batch = findBatch(transform);
+		objects.push_back(object);
+		batches[object.batch].objects.push_back((unsigned int)(objects.size() - 1));
+		return (unsigned int)(objects.size() - 1);
+	}
+
+	// move a static object; its batch is re-baked by the next build()
+	SceneTransform& edit(unsigned int index)
+	{
+		batches[objects[index].batch].dirty = true;
+		return objects[index].transform;
+	}
+
+	bool isDirty() const
+	{
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			if (batches[b].dirty)
+				return true;
+		}
+		return false;
+	}
+
+	// The first call bakes every batch into scene and builds it, with one culling object
+	// per batch in prep. Later calls re-bake only the dirty batches in place. Returns false
+	// if the scene's buffers do not fit in the GPU memory budget.
+	bool build(IndirectScene& scene, ScenePrep& prep)
+	{
+		std::vector<float> vertices;
+		std::vector<GLint> materials;
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			Batch& batch = batches[b];
+			if (!batch.dirty)
+				continue;
+
+			vertices.clear();
+			materials.clear();
+			for (size_t i = 0; i < batch.objects.size(); i++)
+				bake(objects[batch.objects[i]], vertices, materials);
+
+			if (!built)
+			{
+				batch.drawIndex = scene.addMesh(vertices.data(), vertices.size() * sizeof(float), materials.data(), glm::mat4(1.0f));
+				batch.prepObject = prep.addStatic(scene, batch.drawIndex);
+			}
+			else
+			{
+				scene.updateMesh(batch.drawIndex, vertices.data(), vertices.size() * sizeof(float));
+				glm::vec3 low, high;
+				scene.bounds(batch.drawIndex, low, high);
+				prep.setBounds(batch.prepObject, low, high);
+			}
+			batch.dirty = false;
+		}
+
+		if (built)
+			return true;
+		built = true;
+		return scene.build();
+	}
+
+	size_t objectCount() const
+	{
+		return objects.size();
+	}
+
+	size_t batchCount() const
+	{
+		return batches.size();
+	}
+
+private:
+	static const unsigned int FLOATS_PER_VERTEX = 8;
+
+	struct Object
+	{
+		std::vector<float> vertices;		// model space, as given to add()
+		SceneTransform transform;
+		int material;
+		unsigned int batch;
+	};
+
+	struct Batch
+	{
+		std::vector<unsigned int> objects;
+		SceneTransform transform;			// the transform its objects were added with
+		unsigned int drawIndex;				// command in the indirect scene
+		unsigned int prepObject;			// object in the scene prep, for culling
+		bool dirty;
+	};
+
+	std::vector<Object> objects;
+	std::vector<Batch> batches;
+	bool built;
+
+	// objects added with the same transform are co-located and share a batch
+	unsigned int findBatch(const SceneTransform& transform)
+	{
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			const SceneTransform& t = batches[b].transform;
+			if (t.position == transform.position && t.scale == transform.scale && t.angle == transform.angle && t.axis == transform.axis)
+				return (unsigned int)b;
+		}
+		Batch batch;
+		batch.transform = transform;
+		batch.drawIndex = 0;
+		batch.prepObject = 0;
+		batch.dirty = true;
+		batches.push_back(batch);
+		return (unsigned int)(batches.size() - 1);
+	}
+
+	// append an object's vertices to out in world space, with its material per vertex
+	static void bake(const Object& object, std::vector<float>& out, std::vector<GLint>& materials)
+	{
+		glm::mat4 model = object.transform.matrix();
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+		for (size_t i = 0; i + FLOATS_PER_VERTEX <= object.vertices.size(); i += FLOATS_PER_VERTEX)
+		{
+			const float* v = &object.vertices[i];
+			glm::vec4 position = model * glm::vec4(v[0], v[1], v[2], 1.0f);
+			glm::vec3 normal = normalMatrix * glm::vec3(v[3], v[4], v[5]);
+			if (glm::length(normal) > 0.0f)
+				normal = glm::normalize(normal);
+
+			out.push_back(position.x);
+			out.push_back(position.y);
+			out.push_back(position.z);
+			out.push_back(normal.x);
+			out.push_back(normal.y);
+			out.push_back(normal.z);
+			out.push_back(v[6]);
+			out.push_back(v[7]);
+			materials.push_back(object.material);
+		}
+	}
+};
+#endif
@@ -0,0 +1,240 @@
+#ifndef TILED_CAPTURE_H
+#define TILED_CAPTURE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gpu_resources.h"
+#include "png_writer.h"
+
+#include <functional>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+// Renders images far larger than any framebuffer by splitting the projection
+// into sub-frusta, one per tile. Each tile is drawn into a small FBO and read
+// back through a pair of pixel buffer objects, so the read of one tile overlaps
+// drawing the next. Finished bands (a row of tiles) go to a background thread
+// that streams them into a PNG.
+//
+// PNG rows span the whole image width, so the unit handed to the encoder is a
+// band rather than a tile; peak memory is a few bands (tileHeight rows each)
+// plus two tiles of PBO storage, independent of the image height.
+class TiledCapture
+{
+public:
+	typedef std::function<void(const glm::mat4& projection)> DrawFunction;
+
+	int tileWidth;
+	int tileHeight;
+
+	TiledCapture(int tileWidth = 2048, int tileHeight = 256) : tileWidth(tileWidth), tileHeight(tileHeight), finished(false)
+	{
+	}
+
+	// render the scene at width x height with the given full-image projection and write it to path;
+	// draw() must render the whole scene into the bound framebuffer with the projection it is given
+	bool capture(const char* path, int width, int height, const glm::mat4& projection, const DrawFunction& draw)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		size_t tileBytes = (size_t)tileWidth * tileHeight * 4;
+		GpuHandle colorBuffer = gpuResources().createRenderbuffer("capture tile color");
+		GpuHandle depthBuffer = gpuResources().createRenderbuffer("capture tile depth");
+		GpuHandle fbo = gpuResources().createFramebuffer("capture tile target");
+		GpuHandle pbos[2] = { gpuResources().createBuffer("capture readback 0"), gpuResources().createBuffer("capture readback 1") };
+		if (!colorBuffer.track(tileBytes) || !depthBuffer.track(tileBytes) || !pbos[0].track(tileBytes) || !pbos[1].track(tileBytes))
+		{
+			std::cout << "Capture failed: tile buffers do not fit in the GPU memory budget" << std::endl;
+			return false;
+		}
+
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, tileWidth, tileHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, tileWidth, tileHeight);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Capture failed: tile framebuffer is not complete" << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, tileBytes, NULL, GL_STREAM_READ);
+		}
+
+		// only touch the file once the GL side is ready, so a failed setup leaves any old capture intact
+		PngWriter writer;
+		if (!writer.open(path, width, height))
+		{
+			std::cout << "Capture failed: cannot open " << path << std::endl;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+
+		finished = false;
+		std::thread encoder(&TiledCapture::encode, this, std::ref(writer));
+
+		PendingTile pending[2];
+		int current = 0;
+
+		// bands run top to bottom in image order; GL's y axis points up
+		for (int bandTop = 0; bandTop < height; bandTop += tileHeight)
+		{
+			int rows = std::min(tileHeight, height - bandTop);
+			int y = height - bandTop - rows;
+			std::shared_ptr<Band> band(new Band());
+			band->rows = rows;
+			band->pixels.resize((size_t)width * rows * 3);
+
+			for (int x = 0; x < width; x += tileWidth)
+			{
+				int columns = std::min(tileWidth, width - x);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+				glViewport(0, 0, columns, rows);
+				glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				draw(tileProjection(projection, x, y, columns, rows, width, height));
+
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[current]);
+				glReadPixels(0, 0, columns, rows, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+				pending[current].band = band;
+				pending[current].x = x;
+				pending[current].columns = columns;
+				pending[current].lastInBand = x + columns >= width;
+				pending[current].imageWidth = width;
+
+				// the other PBO was filled one tile ago and should be ready without a stall
+				current = 1 - current;
+				collect(pending[current], pbos[current]);
+			}
+		}
+		current = 1 - current;
+		collect(pending[current], pbos[current]);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			finished = true;
+		}
+		queueReady.notify_all();
+		encoder.join();
+
+		bool ok = writer.close();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (ok)
+			std::cout << "Captured " << width << "x" << height << " to " << path << " in " << seconds << " s" << std::endl;
+		else
+			std::cout << "Capture failed: error writing " << path << std::endl;
+		return ok;
+	}
+
+	// crop a projection to the part of clip space covered by one tile;
+	// works the same for perspective and orthographic projections
+	static glm::mat4 tileProjection(const glm::mat4& projection, int x, int y, int columns, int rows, int width, int height)
+	{
+		float left = 2.0f * x / width - 1.0f;
+		float right = 2.0f * (x + columns) / width - 1.0f;
+		float bottom = 2.0f * y / height - 1.0f;
+		float top = 2.0f * (y + rows) / height - 1.0f;
+
+		glm::mat4 crop = glm::mat4(1.0f);
+		crop[0][0] = 2.0f / (right - left);
+		crop[1][1] = 2.0f / (top - bottom);
+		crop[3][0] = -(right + left) / (right - left);
+		crop[3][1] = -(top + bottom) / (top - bottom);
+		return crop * projection;
+	}
+
+private:
+	static const size_t MAX_QUEUED_BANDS = 2;
+
+	struct Band
+	{
+		std::vector<unsigned char> pixels;		// RGB, top row first
+		int rows;
+	};
+
+	struct PendingTile
+	{
+		std::shared_ptr<Band> band;
+		int x, columns, imageWidth;
+		bool lastInBand;
+	};
+
+	std::deque<std::shared_ptr<Band> > queue;
+	std::mutex queueMutex;
+	std::condition_variable queueReady, queueSpace;
+	bool finished;
+
+	// copy a read-back tile into its band, flipping it upright and dropping alpha
+	void collect(PendingTile& tile, GLuint pbo)
+	{
+		if (!tile.band)
+			return;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		const unsigned char* data = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (data)
+		{
+			int rows = tile.band->rows;
+			for (int r = 0; r < rows; r++)
+			{
+				const unsigned char* src = data + (size_t)r * tile.columns * 4;
+				unsigned char* dst = &tile.band->pixels[((size_t)(rows - 1 - r) * tile.imageWidth + tile.x) * 3];
+				for (int c = 0; c < tile.columns; c++)
+				{
+					dst[c * 3 + 0] = src[c * 4 + 0];
+					dst[c * 3 + 1] = src[c * 4 + 1];
+					dst[c * 3 + 2] = src[c * 4 + 2];
+				}
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+
+		if (tile.lastInBand)
+		{
+			// wait for the encoder to make room, which bounds the memory held in bands
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueSpace.wait(lock, [this] { return queue.size() < MAX_QUEUED_BANDS; });
+			queue.push_back(tile.band);
+			lock.unlock();
+			queueReady.notify_one();
+		}
+		tile.band.reset();
+	}
+
+	// encoder thread: stream bands into the PNG in order until the last one is in
+	void encode(PngWriter& writer)
+	{
+		for (;;)
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueReady.wait(lock, [this] { return !queue.empty() || finished; });
+			if (queue.empty())
+				return;
+			std::shared_ptr<Band> band = queue.front();
+			queue.pop_front();
+			lock.unlock();
+			queueSpace.notify_one();
+
+			writer.writeRows(&band->pixels[0], band->rows);
+		}
+	}
+};
+#endif